@@ -0,0 +1,22 @@
+#ifndef ALLOC_CHECK_H
+#define ALLOC_CHECK_H
+
+// Replaces the global operator new with a counting version so a check
+// build (-DALLOC_CHECK) can assert that the game loop never touches the
+// heap. Include from exactly one translation unit.
+
+#include <new>
+#include <cstdlib>
+
+static long allocationCount = 0;
+
+void* operator new(std::size_t size) {
+    allocationCount++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, std::size_t) noexcept { free(p); }
+
+#endif
@@ -0,0 +1,175 @@
+// Replay archive tool: packs replay files into one archive and lists or
+// extracts the games in it.
+//
+//   g++ -O2 archive.cpp -o tetris-archive
+//   ./tetris-archive add ARCHIVE FILE... [--name NAME]
+//   ./tetris-archive list ARCHIVE [--name NAME] [--top K | --recent K]
+//   ./tetris-archive extract ARCHIVE ID OUT
+//
+// add replays every game before archiving it, so the score and lines in
+// the index are the simulated ones, and commits once at the end.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+using namespace std;
+
+#include "replay.h"
+#include "archive.h"
+
+// Plays one replay to its end, leaving the reader past its results.
+// Fills in the best player's score and lines and the number of ticks.
+template <int W, int H>
+static bool summarize(ReplayReader& reader, const ReplayHeader& header, ArchiveEntry& entry) {
+    ReplayCursor<W, H> cursor(reader, header);
+    bool ok = cursor.finish();
+    reader = cursor.getReader();
+    if (!ok) return false;
+    entry.ticks = (uint32_t)cursor.getTick();
+    entry.score = -1;
+    for (int p = 0; p < header.players; ++p) {
+        ReplayResult recorded, actual = resultOf(cursor.getEngine(p));
+        if (reader.getVersion() >= 2 && !reader.result(recorded)) return false;
+        if (actual.score > entry.score) {
+            entry.score = actual.score;
+            entry.lines = actual.lines;
+        }
+    }
+    return true;
+}
+
+static bool summarizeAny(ReplayReader& reader, const ReplayHeader& header, ArchiveEntry& entry) {
+    if (header.height != DEFAULT_HEIGHT) return false;
+    if (header.width == 4) return summarize<4, DEFAULT_HEIGHT>(reader, header, entry);
+    if (header.width == 10) return summarize<10, DEFAULT_HEIGHT>(reader, header, entry);
+    if (header.width == 40) return summarize<40, DEFAULT_HEIGHT>(reader, header, entry);
+    return false;
+}
+
+static int add(const char* path, const vector<string>& files, const string& name) {
+    ArchiveWriter writer;
+    if (!writer.open(path)) {
+        cout << "Cannot open archive " << path << " for writing\n";
+        return 1;
+    }
+    size_t before = writer.getCount();
+    vector<uint8_t> data;
+    for (const string& file : files) {
+        if (!readReplayFile(file.c_str(), data)) {
+            cout << "Cannot read " << file << "\n";
+            return 1;
+        }
+        ReplayReader reader(data.data(), data.size());
+        while (reader.position() < data.data() + data.size()) {
+            const uint8_t* begin = reader.position();
+            ReplayHeader header;
+            ArchiveEntry entry = {};
+            if (!reader.header(header) || !summarizeAny(reader, header, entry)) {
+                cout << file << ": not a valid replay, nothing added\n";
+                return 1;
+            }
+            if (writer.add(begin, reader.position() - begin, name.c_str(), entry.score,
+                           entry.lines, entry.ticks) < 0) {
+                cout << "Cannot write to " << path << "\n";
+                return 1;
+            }
+        }
+    }
+    if (!writer.commit()) {
+        cout << "Cannot write to " << path << "\n";
+        return 1;
+    }
+    cout << "Added " << writer.getCount() - before << " games to " << path << " ("
+         << writer.getCount() << " in all)\n";
+    return 0;
+}
+
+// Lists games in id order, or the top K by score, or the K most recently
+// added. The archive's sorted ids answer each of these, and --name, from
+// its run of the name array, without a pass over every entry.
+static int list(const char* path, const string& name, long top, long recent) {
+    ArchiveReader archive;
+    if (!archive.open(path)) {
+        cout << "Cannot read archive " << path << "\n";
+        return 1;
+    }
+    long count = (long)archive.getCount();
+    vector<const ArchiveEntry*> shown;
+    if (!name.empty()) {
+        const uint32_t *first, *last;
+        archive.named(name.c_str(), first, last);
+        for (const uint32_t* id = first; id != last; ++id) shown.push_back(&archive.entry(*id));
+        long keep = top > 0 ? top : recent > 0 ? recent : 0;
+        if (keep > 0) {
+            keep = min(keep, (long)shown.size());
+            partial_sort(shown.begin(), shown.begin() + keep, shown.end(),
+                         [&](const ArchiveEntry* a, const ArchiveEntry* b) {
+                             if (top > 0 && a->score != b->score) return a->score > b->score;
+                             if (top <= 0 && a->date != b->date) return a->date > b->date;
+                             return top > 0 ? a->id < b->id : a->id > b->id;
+                         });
+            shown.resize(keep);
+        }
+    } else if (top > 0) {
+        for (long i = 0; i < min(top, count); ++i) shown.push_back(&archive.entry(archive.byScore()[i]));
+    } else if (recent > 0) {
+        for (long i = count - 1; i >= max(0L, count - recent); --i)
+            shown.push_back(&archive.entry(archive.byDate()[i]));
+    } else {
+        for (long id = 0; id < count; ++id) shown.push_back(&archive.entry(id));
+    }
+
+    cout << "id\tdate\t\t\tscore\tlines\tticks\tbytes\tname\n";
+    for (const ArchiveEntry* e : shown) {
+        char date[32];
+        time_t t = (time_t)e->date;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        cout << e->id << "\t" << date << "\t" << e->score << "\t" << e->lines << "\t" << e->ticks
+             << "\t" << e->length << "\t" << (e->name[0] ? e->name : "-") << "\n";
+    }
+    return 0;
+}
+
+static int extract(const char* path, long id, const char* out) {
+    ArchiveReader archive;
+    if (!archive.open(path)) {
+        cout << "Cannot read archive " << path << "\n";
+        return 1;
+    }
+    if (id < 0 || id >= (long)archive.getCount()) {
+        cout << "No game " << id << " in " << path << "\n";
+        return 1;
+    }
+    FILE* f = fopen(out, "wb");
+    if (!f || fwrite(archive.replay(id), 1, archive.entry(id).length, f) != archive.entry(id).length) {
+        cout << "Cannot write " << out << "\n";
+        if (f) fclose(f);
+        return 1;
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    string command = argc > 2 ? argv[1] : "";
+    string name;
+    long top = 0, recent = 0;
+    vector<string> args;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc) name = argv[++i];
+        else if (arg == "--top" && i + 1 < argc) top = atol(argv[++i]);
+        else if (arg == "--recent" && i + 1 < argc) recent = atol(argv[++i]);
+        else args.push_back(arg);
+    }
+
+    if (command == "add" && args.size() >= 2)
+        return add(args[0].c_str(), vector<string>(args.begin() + 1, args.end()), name);
+    if (command == "list" && args.size() == 1) return list(args[0].c_str(), name, top, recent);
+    if (command == "extract" && args.size() == 3)
+        return extract(args[0].c_str(), atol(args[1].c_str()), args[2].c_str());
+    cout << "Usage: tetris-archive add ARCHIVE FILE... [--name NAME]\n"
+            "       tetris-archive list ARCHIVE [--name NAME] [--top K | --recent K]\n"
+            "       tetris-archive extract ARCHIVE ID OUT\n";
+    return 1;
+}
@@ -0,0 +1,376 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+// Append-only archive of many replays in one file, with an index at the
+// end that readers map and use in place:
+//
+//   header (128 bytes): "TARC" version, then two commit slots
+//   replay* index  replay* index ...
+//   index: ArchiveEntry[count], then uint32_t[count] ids by name, by
+//          score (highest first) and by date (oldest first)
+//
+// The index is keyed by id (entry i has id i) and the three sorted id
+// arrays key it by name, score and date, so readers look games up by
+// binary search or read the best or newest off one end instead of
+// scanning every entry. Each commit slot names the offset and size of an
+// index and carries a checksum of it, sorted arrays included, and of
+// itself. A commit writes the new replays and then
+// a full new index past the end of the old one, syncs them, and only then
+// overwrites the older of the two slots with a higher sequence number.
+// A crash at any point leaves the other slot, and the index it names,
+// intact, so readers always see the last completed commit; the next
+// writer truncates whatever a failed commit left past it. Each commit
+// leaves the index before it behind as dead space (76 bytes per game
+// already archived), so writers should commit in batches.
+//
+// Multi-byte fields are little-endian, as on every
+// machine this builds for.
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "archives are read in place");
+
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_DATA 128 // first replay's offset
+
+const char ARCHIVE_MAGIC[4] = {'T', 'A', 'R', 'C'};
+
+struct ArchiveEntry {
+    uint64_t id;
+    uint64_t offset;   // of the replay, from the start of the file
+    uint32_t length;   // bytes
+    int32_t score;     // best player's
+    int64_t date;      // seconds since the epoch when it was added
+    uint32_t lines;    // best player's
+    uint32_t ticks;
+    char name[24];     // player name(s), NUL-padded
+};
+static_assert(sizeof(ArchiveEntry) == 64, "ArchiveEntry is an on-disk record");
+
+struct ArchiveSlot {
+    uint64_t sequence;    // 0 = never written
+    uint64_t indexOffset;
+    uint64_t count;
+    uint64_t indexSum;    // of the entries and the sorted id arrays
+    uint64_t slotSum;     // of the four fields above
+};
+
+// Bytes of an index of count entries: the entries and three id arrays.
+inline uint64_t archiveIndexSize(uint64_t count) {
+    return count * (sizeof(ArchiveEntry) + 3 * sizeof(uint32_t));
+}
+
+// Order of the name array: by name, then by id.
+inline bool archiveNameBefore(const ArchiveEntry& a, const ArchiveEntry& b) {
+    int c = strncmp(a.name, b.name, sizeof(a.name));
+    return c < 0 || (c == 0 && a.id < b.id);
+}
+
+inline uint64_t archiveSum(const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t sum = size;
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        sum = mix64(sum ^ word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, size);
+    return mix64(sum ^ tail);
+}
+
+inline bool archiveSlotValid(const ArchiveSlot& slot) {
+    return slot.sequence && slot.slotSum == archiveSum(&slot, offsetof(ArchiveSlot, slotSum));
+}
+
+// The newer valid slot of a header, or null if neither is valid.
+inline const ArchiveSlot* archiveCommitted(const uint8_t* header) {
+    if (memcmp(header, ARCHIVE_MAGIC, 4) != 0 || header[4] != ARCHIVE_VERSION) return nullptr;
+    const ArchiveSlot* slots = (const ArchiveSlot*)(header + 8);
+    const ArchiveSlot* best = nullptr;
+    for (int i = 0; i < 2; ++i)
+        if (archiveSlotValid(slots[i]) && (!best || slots[i].sequence > best->sequence))
+            best = &slots[i];
+    return best;
+}
+
+// Read-only view of an archive, mapped whole. Opening costs one pass over
+// the index to check it; replays are returned as pointers into the map.
+class ArchiveReader {
+private:
+    const uint8_t* base;
+    size_t size;
+    const ArchiveEntry* index;
+    const uint32_t* sorted; // by name, by score, by date; count each
+    size_t count;
+
+public:
+    ArchiveReader() : base(nullptr), size(0), index(nullptr), sorted(nullptr), count(0) {}
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+    ~ArchiveReader() { close(); }
+
+    // False if the file cannot be mapped or is not a committed archive.
+    bool open(const char* path) {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        void* map = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size >= ARCHIVE_DATA)
+            map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) return false;
+        base = (const uint8_t*)map;
+        size = info.st_size;
+
+        const ArchiveSlot* slot = archiveCommitted(base);
+        // The slot's checksum only shows it was written whole; a copy cut
+        // short can still end before the index it points at.
+        if (!slot || slot->indexOffset < ARCHIVE_DATA || slot->indexOffset % 8
+            || slot->indexOffset > size || slot->count > UINT32_MAX
+            || archiveIndexSize(slot->count) > size - slot->indexOffset
+            || archiveSum(base + slot->indexOffset, archiveIndexSize(slot->count)) != slot->indexSum) {
+            close();
+            return false;
+        }
+        index = (const ArchiveEntry*)(base + slot->indexOffset);
+        count = slot->count;
+        sorted = (const uint32_t*)(index + count);
+        for (size_t i = 0; i < count; ++i)
+            if (index[i].offset < ARCHIVE_DATA || index[i].offset > slot->indexOffset
+                || index[i].length > slot->indexOffset - index[i].offset) {
+                close();
+                return false;
+            }
+        for (size_t i = 0; i < 3 * count; ++i)
+            if (sorted[i] >= count) {
+                close();
+                return false;
+            }
+        return true;
+    }
+
+    void close() {
+        if (base) munmap((void*)base, size);
+        base = nullptr;
+        size = count = 0;
+        index = nullptr;
+        sorted = nullptr;
+    }
+
+    size_t getCount() const { return count; }
+    const ArchiveEntry& entry(size_t id) const { return index[id]; }
+    const uint8_t* replay(size_t id) const { return base + index[id].offset; }
+
+    // Ids of every game, count of them, by name (then id), by score
+    // (highest first, then id) and by date (oldest first, then id).
+    const uint32_t* byName() const { return sorted; }
+    const uint32_t* byScore() const { return sorted + count; }
+    const uint32_t* byDate() const { return sorted + 2 * count; }
+
+    // The run of byName() holding the games of player name (cut to 23
+    // characters, as stored).
+    void named(const char* name, const uint32_t*& first, const uint32_t*& last) const {
+        char key[sizeof(ArchiveEntry::name)] = {};
+        strncpy(key, name, sizeof(key) - 1);
+        first = lower_bound(byName(), byName() + count, key, [&](uint32_t id, const char* k) {
+            return strncmp(index[id].name, k, sizeof(key)) < 0;
+        });
+        last = upper_bound(first, byName() + count, key, [&](const char* k, uint32_t id) {
+            return strncmp(k, index[id].name, sizeof(key)) < 0;
+        });
+    }
+};
+
+// Appends replays to an archive, creating it if needed. Holds an
+// exclusive lock on the file while open. Nothing added is visible to
+// readers until commit() returns true; replays added but not committed
+// when the writer is closed are dropped.
+class ArchiveWriter {
+private:
+    int fd;
+    vector<ArchiveEntry> entries;
+    uint64_t sequence;
+    uint64_t end;       // where the next replay goes
+    size_t committed;   // entries covered by the last commit
+
+    bool writeAll(const void* data, size_t n, uint64_t at) {
+        const uint8_t* p = (const uint8_t*)data;
+        while (n) {
+            ssize_t w = pwrite(fd, p, n, at);
+            if (w <= 0) return false;
+            p += w;
+            at += w;
+            n -= w;
+        }
+        return true;
+    }
+
+    bool readAll(void* data, size_t n, uint64_t at) {
+        uint8_t* p = (uint8_t*)data;
+        while (n) {
+            ssize_t r = pread(fd, p, n, at);
+            if (r <= 0) return false;
+            p += r;
+            at += r;
+            n -= r;
+        }
+        return true;
+    }
+
+    // The entries followed by the three sorted id arrays, as committed.
+    void buildIndex(vector<uint8_t>& out) const {
+        size_t n = entries.size();
+        vector<uint32_t> ids(3 * n);
+        for (size_t i = 0; i < n; ++i) ids[i] = ids[n + i] = ids[2 * n + i] = (uint32_t)i;
+        const vector<ArchiveEntry>& e = entries;
+        sort(ids.begin(), ids.begin() + n,
+             [&](uint32_t a, uint32_t b) { return archiveNameBefore(e[a], e[b]); });
+        sort(ids.begin() + n, ids.begin() + 2 * n, [&](uint32_t a, uint32_t b) {
+            return e[a].score != e[b].score ? e[a].score > e[b].score : a < b;
+        });
+        sort(ids.begin() + 2 * n, ids.end(), [&](uint32_t a, uint32_t b) {
+            return e[a].date != e[b].date ? e[a].date < e[b].date : a < b;
+        });
+        out.resize(archiveIndexSize(n));
+        memcpy(out.data(), e.data(), n * sizeof(ArchiveEntry));
+        memcpy(out.data() + n * sizeof(ArchiveEntry), ids.data(), ids.size() * sizeof(uint32_t));
+    }
+
+    // Points the older slot at index, written at indexOffset.
+    bool writeSlot(uint64_t indexOffset, const vector<uint8_t>& index) {
+        ArchiveSlot slot;
+        slot.sequence = sequence + 1;
+        slot.indexOffset = indexOffset;
+        slot.count = entries.size();
+        slot.indexSum = archiveSum(index.data(), index.size());
+        slot.slotSum = archiveSum(&slot, offsetof(ArchiveSlot, slotSum));
+        if (!writeAll(&slot, sizeof(slot), 8 + slot.sequence % 2 * sizeof(ArchiveSlot))) return false;
+        if (fdatasync(fd) != 0) return false;
+        sequence = slot.sequence;
+        committed = entries.size();
+        return true;
+    }
+
+public:
+    ArchiveWriter() : fd(-1), sequence(0), end(0), committed(0) {}
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+    ~ArchiveWriter() { close(); }
+
+    // Opens or creates path. False if it cannot be opened, is locked by
+    // another writer or is not an archive.
+    bool open(const char* path) {
+        close();
+        fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+        struct stat info;
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &info) != 0) {
+            close();
+            return false;
+        }
+        entries.clear();
+        uint8_t header[ARCHIVE_DATA] = {};
+        if (info.st_size > 0 && (info.st_size < ARCHIVE_DATA || !readAll(header, sizeof(header), 0))) {
+            close();
+            return false;
+        }
+        const ArchiveSlot* slot = archiveCommitted(header);
+        // A new file, or one whose creation was cut short before its first
+        // commit.
+        if (!slot && (info.st_size == 0 || (info.st_size == ARCHIVE_DATA
+                                            && memcmp(header, ARCHIVE_MAGIC, 4) == 0))) {
+            memset(header, 0, sizeof(header));
+            memcpy(header, ARCHIVE_MAGIC, 4);
+            header[4] = ARCHIVE_VERSION;
+            sequence = 0;
+            end = ARCHIVE_DATA;
+            if (!writeAll(header, sizeof(header), 0) || !writeSlot(ARCHIVE_DATA, vector<uint8_t>())) {
+                close();
+                return false;
+            }
+            return true;
+        }
+        if (!slot) {
+            close();
+            return false;
+        }
+        sequence = slot->sequence;
+        if (slot->indexOffset > (uint64_t)info.st_size || slot->count > UINT32_MAX
+            || archiveIndexSize(slot->count) > info.st_size - slot->indexOffset) {
+            close();
+            return false;
+        }
+        end = slot->indexOffset + archiveIndexSize(slot->count);
+        vector<uint8_t> index(archiveIndexSize(slot->count));
+        if (!readAll(index.data(), index.size(), slot->indexOffset)
+            || archiveSum(index.data(), index.size()) != slot->indexSum
+            || ftruncate(fd, end) != 0) {
+            close();
+            return false;
+        }
+        entries.resize(slot->count);
+        memcpy(entries.data(), index.data(), entries.size() * sizeof(ArchiveEntry));
+        committed = entries.size();
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        entries.clear();
+        committed = 0;
+    }
+
+    // Writes one replay after the last and queues its index entry; name
+    // is cut to 23 characters. Returns its id, or -1 on a write error.
+    long add(const uint8_t* data, size_t length, const char* name, int score, int lines,
+             long ticks, int64_t date = time(nullptr)) {
+        if (fd < 0 || !writeAll(data, length, end)) return -1;
+        ArchiveEntry e = {};
+        e.id = entries.size();
+        e.offset = end;
+        e.length = (uint32_t)length;
+        e.score = score;
+        e.date = date;
+        e.lines = (uint32_t)lines;
+        e.ticks = (uint32_t)ticks;
+        strncpy(e.name, name, sizeof(e.name) - 1);
+        entries.push_back(e);
+        end += length;
+        return (long)e.id;
+    }
+
+    // Makes every replay added so far visible. On failure nothing added
+    // since the last commit is visible and the writer must be reopened.
+    bool commit() {
+        if (fd < 0) return false;
+        if (committed == entries.size()) return true;
+        uint64_t indexOffset = (end + 7) & ~7ull;
+        vector<uint8_t> index;
+        buildIndex(index);
+        if (!writeAll(index.data(), index.size(), indexOffset)
+            || fdatasync(fd) != 0 || !writeSlot(indexOffset, index)) {
+            close();
+            return false;
+        }
+        end = indexOffset + index.size();
+        return true;
+    }
+
+    size_t getCount() const { return entries.size(); }
+};
+
+#endif
@@ -0,0 +1,678 @@
+// Micro-benchmarks for the board code shared by both games.
+//
+//   g++ -O2 -pthread -march=native bench.cpp -o bench
+//   ./bench [collision|snapshot|step|batch|replay|seek|movegen|perft [DEPTH]|features|mcts]
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+using namespace std;
+
+#include "batch.h"
+#include "replay.h"
+#include "bot.h"
+#include "movegen.h"
+#include "mcts.h"
+
+// Prevents the optimiser from discarding a benchmark's result.
+static volatile long sink;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+const int H = DEFAULT_HEIGHT;
+
+static Tetromino randomPiece(mt19937& rng, int width) {
+    Tetromino t((TetrominoType)(rng() % 7), width/2 - 2);
+    for (int r = rng() % 4; r > 0; --r) t.rotate();
+    return t;
+}
+
+// Boards with a ragged stack of dropped pieces, roughly half full.
+template <int W>
+static vector<Grid<W, H>> randomBoards(mt19937& rng, int count) {
+    vector<Grid<W, H>> boards(count);
+    for (Grid<W, H>& grid : boards) {
+        for (int n = 0; n < W * 5 / 2; ++n) {
+            Tetromino t = randomPiece(rng, W);
+            t.move((int)(rng() % W) - t.getX() - 1, 0);
+            if (grid.isCollision(t)) continue;
+            Tetromino next = t;
+            next.move(0, 1);
+            while (!grid.isCollision(next)) { t = next; next.move(0, 1); }
+            grid.merge(t);
+        }
+    }
+    return boards;
+}
+
+// The per-cell test Grid::isCollision used before the row-mask kernel.
+template <int W>
+static bool cellCollision(const Grid<W, H>& grid, const Tetromino& t) {
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            if (t.isCell(i, j)) {
+                int nx = t.getX() + j;
+                int ny = t.getY() + i;
+                if (nx < 0 || nx >= W || ny >= H) return true;
+                if (ny >= 0 && ((grid.getRow(ny) >> nx) & 1)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+template <int W>
+static void benchCollision() {
+    const int BOARDS = 64, PROBES = 4096, ROUNDS = 400;
+    mt19937 rng(12345);
+    vector<Grid<W, H>> boards = randomBoards<W>(rng, BOARDS);
+    vector<Tetromino> probes;
+    for (int n = 0; n < PROBES; ++n) {
+        Tetromino t = randomPiece(rng, W);
+        t.move((int)(rng() % (W + 3)) - 2 - t.getX(), (int)(rng() % H));
+        probes.push_back(t);
+    }
+
+    long tests = (long)BOARDS * PROBES * ROUNDS;
+    long hitsCell = 0, hitsMask = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (const Grid<W, H>& grid : boards)
+            for (const Tetromino& t : probes)
+                hitsCell += cellCollision(grid, t);
+    double cellSecs = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (const Grid<W, H>& grid : boards)
+            for (const Tetromino& t : probes)
+                hitsMask += grid.isCollision(t);
+    double maskSecs = secondsSince(start);
+
+    sink = hitsCell + hitsMask;
+    cout << "collision " << W << "x" << H << ": per-cell  " << tests / cellSecs / 1e6 << " M tests/s\n";
+    cout << "collision " << W << "x" << H << ": row-mask  " << tests / maskSecs / 1e6 << " M tests/s"
+         << "  (" << cellSecs / maskSecs << "x)\n";
+    if (hitsCell != hitsMask) {
+        cout << "collision: MISMATCH " << hitsCell << " vs " << hitsMask << "\n";
+        exit(1);
+    }
+}
+
+// Snapshot/restore is a copy of GameState in each direction; time a round
+// trip through a ring of saved states, as undo or search would use them.
+template <int W>
+static void benchSnapshot() {
+    const int SLOTS = 64;
+    const long ROUNDS = 4000000;
+    mt19937 rng(777);
+    GameState<W, H> live{randomBoards<W>(rng, 1)[0], randomPiece(rng, W), PieceQueue(), 0, 0, 1, false, false};
+    live.queue.reset(42);
+    vector<GameState<W, H>> saved(SLOTS, live);
+
+    auto start = chrono::steady_clock::now();
+    for (long n = 0; n < ROUNDS; ++n) {
+        saved[n % SLOTS] = live;                              // snapshot
+        live.score += 1;
+        memcpy(&live, &saved[(n * 7) % SLOTS], sizeof(live)); // restore
+    }
+    double secs = secondsSince(start);
+
+    sink = live.score;
+    cout << "snapshot " << W << "x" << H << ": " << sizeof(GameState<W, H>) << " bytes, "
+         << ROUNDS / secs / 1e6 << " M snapshot+restore/s\n";
+}
+
+// Headless play: an Engine stepped with a fixed key script, no terminal
+// or sleeps, restarting whenever a game ends.
+template <int W>
+static void benchStep() {
+    const long TICKS = 2000000;
+    const Input script[] = {Input::Left, Input::None, Input::Rotate, Input::Right, Input::Right,
+                            Input::None, Input::HardDrop, Input::Left, Input::SoftDrop, Input::HardDrop};
+    const int scriptLen = sizeof(script) / sizeof(script[0]);
+    Engine<W, H> engine(1);
+    long games = 1, lines = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (long n = 0; n < TICKS; ++n) {
+        Events events = engine.step(script[n % scriptLen]);
+        lines += __builtin_popcount(events.cleared);
+        if (engine.isGameOver()) { engine = Engine<W, H>(n); games++; }
+    }
+    double secs = secondsSince(start);
+
+    sink = lines;
+    cout << "step " << W << "x" << H << ": " << TICKS / secs / 1e6 << " M ticks/s ("
+         << games << " games)\n";
+}
+
+// Lockstep batch of 32 boards against the scalar Grid path: the same
+// collision probes, the full-row check, and whole games stepped with the
+// same inputs, which must end on identical boards and scores. Then games
+// that clear rows, checked against Engines after every tick.
+template <int W>
+static void benchBatch() {
+    const int N = 32, PROBES = 4096, ROUNDS = 200;
+    mt19937 rng(4242);
+    vector<Grid<W, H>> boards = randomBoards<W>(rng, N);
+    GridBatch<N, W, H> batch;
+    for (int lane = 0; lane < N; ++lane) batch.load(lane, boards[lane]);
+
+    vector<Tetromino> pieces;
+    vector<BatchProbe<N>> probes(PROBES);
+    for (int n = 0; n < PROBES; ++n) {
+        for (int lane = 0; lane < N; ++lane) {
+            Tetromino t = randomPiece(rng, W);
+            t.move((int)(rng() % (W + 3)) - 2 - t.getX(), (int)(rng() % H));
+            pieces.push_back(t);
+            GridBatch<N, W, H>::place(probes[n], lane, (int)t.getType(), t.getRotation(), t.getX(), t.getY());
+        }
+    }
+
+    long tests = (long)PROBES * N * ROUNDS;
+    long gridSum = 0, scalarSum = 0, simdSum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (int n = 0; n < PROBES; ++n) {
+            uint32_t hits = 0;
+            for (int lane = 0; lane < N; ++lane)
+                hits |= (uint32_t)boards[lane].isCollision(pieces[n * N + lane]) << lane;
+            gridSum += hits ^ n;
+        }
+    double gridSecs = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (int n = 0; n < PROBES; ++n) scalarSum += batch.collideScalar(probes[n]) ^ n;
+    double scalarSecs = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (int n = 0; n < PROBES; ++n) simdSum += batch.collide(probes[n]) ^ n;
+    double simdSecs = secondsSince(start);
+
+    cout << "batch " << W << "x" << H << ": Grid::isCollision   " << tests / gridSecs / 1e6 << " M tests/s\n";
+    cout << "batch " << W << "x" << H << ": collide (scalar)    " << tests / scalarSecs / 1e6 << " M tests/s\n";
+    cout << "batch " << W << "x" << H << ": collide (" << BATCH_ISA << ")" << string(10 - strlen(BATCH_ISA), ' ')
+         << tests / simdSecs / 1e6 << " M tests/s  (" << gridSecs / simdSecs << "x)\n";
+    if (gridSum != scalarSum || gridSum != simdSum) {
+        cout << "batch: collision MISMATCH\n";
+        exit(1);
+    }
+
+    // Full-row check over every row of every board, as the lock path does
+    // before clearing.
+    const long CHECKS = 200000;
+    long gridFull = 0, batchFull = 0;
+    start = chrono::steady_clock::now();
+    for (long n = 0; n < CHECKS; ++n) {
+        uint32_t lanes = 0;
+        for (int lane = 0; lane < N; ++lane)
+            for (int y = 0; y < H; ++y)
+                if (boards[lane].getRow(y) == (typename Grid<W, H>::Row)(((uint64_t)1 << W) - 1)) lanes |= 1u << lane;
+        gridFull += lanes ^ n;
+        sink = lanes;
+    }
+    gridSecs = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (long n = 0; n < CHECKS; ++n) {
+        uint32_t lanes = batch.fullLanes();
+        batchFull += lanes ^ n;
+        sink = lanes;
+    }
+    simdSecs = secondsSince(start);
+    cout << "batch " << W << "x" << H << ": full-row check  Grid " << CHECKS * N / gridSecs / 1e6
+         << " M boards/s, " << BATCH_ISA << " " << CHECKS * N / simdSecs / 1e6 << " M boards/s  ("
+         << gridSecs / simdSecs << "x)\n";
+    if (gridFull != batchFull) {
+        cout << "batch: full-row MISMATCH\n";
+        exit(1);
+    }
+
+    // Whole games: N Engines one after another versus one BatchEngine,
+    // each lane restarting with a fresh seed when its game ends.
+    const long TICKS = 20000;
+    const Input keys[] = {Input::Left, Input::None, Input::Rotate, Input::Right, Input::Right,
+                          Input::None, Input::HardDrop, Input::Left, Input::SoftDrop, Input::HardDrop};
+    uint64_t seeds[N];
+    for (int lane = 0; lane < N; ++lane) seeds[lane] = 100 + lane;
+    vector<Input> script((size_t)TICKS * N);
+    for (Input& in : script) in = keys[rng() % 10];
+
+    vector<Engine<W, H>> engines;
+    for (int lane = 0; lane < N; ++lane) engines.emplace_back(seeds[lane]);
+    start = chrono::steady_clock::now();
+    for (long t = 0; t < TICKS; ++t)
+        for (int lane = 0; lane < N; ++lane) {
+            engines[lane].step(script[t * N + lane]);
+            if (engines[lane].isGameOver()) engines[lane] = Engine<W, H>(t * N + lane);
+        }
+    double engineSecs = secondsSince(start);
+
+    BatchEngine<N, W, H> lockstep(seeds);
+    start = chrono::steady_clock::now();
+    for (long t = 0; t < TICKS; ++t) {
+        uint32_t over = lockstep.step(&script[t * N]).gameOver;
+        for (; over; over &= over - 1) lockstep.reset(__builtin_ctz(over), t * N + __builtin_ctz(over));
+    }
+    double lockstepSecs = secondsSince(start);
+
+    cout << "batch " << W << "x" << H << ": games  Engine " << TICKS * N / engineSecs / 1e6
+         << " M ticks/s, BatchEngine " << TICKS * N / lockstepSecs / 1e6 << " M ticks/s  ("
+         << engineSecs / lockstepSecs << "x)\n";
+    for (int lane = 0; lane < N; ++lane) {
+        bool same = engines[lane].getScore() == lockstep.getScore(lane);
+        for (int y = 0; y < H; ++y)
+            same = same && engines[lane].getGrid().getRow(y) == lockstep.getGrid().getRow(lane, y);
+        if (!same) {
+            cout << "batch: lane " << lane << " diverged from Engine\n";
+            exit(1);
+        }
+    }
+
+    // Random keys seldom fill a row, so here each lane is fed the greedy
+    // policy's inputs for its Engine, one a tick, and the lane's rows,
+    // column heights, score and game over must match its Engine's after
+    // every tick. A lock drops the rest of the plan.
+    const long CHECK_TICKS = 20000;
+    vector<Engine<W, H>> reference;
+    for (int lane = 0; lane < N; ++lane) reference.emplace_back(seeds[lane]);
+    BatchEngine<N, W, H> checked(seeds);
+    Input plans[N][BOT_MAX_INPUTS];
+    int planned[N] = {}, next[N] = {};
+    long rows = 0;
+    for (long t = 0; t < CHECK_TICKS; ++t) {
+        Input inputs[N];
+        for (int lane = 0; lane < N; ++lane) {
+            if (next[lane] == planned[lane]) {
+                planned[lane] = greedyInputs(reference[lane], plans[lane]);
+                next[lane] = 0;
+            }
+            inputs[lane] = next[lane] < planned[lane] ? plans[lane][next[lane]++] : Input::None;
+        }
+        BatchEvents batchEvents = checked.step(inputs);
+        for (int lane = 0; lane < N; ++lane) {
+            Engine<W, H>& engine = reference[lane];
+            Events events = engine.step(&inputs[lane], 1);
+            rows += __builtin_popcount(events.cleared);
+            bool same = engine.getScore() == checked.getScore(lane)
+                     && engine.isGameOver() == checked.isGameOver(lane)
+                     && (events.cleared != 0) == (bool)(batchEvents.cleared >> lane & 1);
+            for (int y = 0; y < H; ++y)
+                same = same && engine.getGrid().getRow(y) == checked.getGrid().getRow(lane, y);
+            for (int x = 0; x < W; ++x)
+                same = same && engine.getGrid().getHeight(x) == checked.getGrid().getHeight(lane, x);
+            if (!same) {
+                cout << "batch: lane " << lane << " diverged from Engine at tick " << t << "\n";
+                exit(1);
+            }
+            if (events.locked) planned[lane] = next[lane] = 0;
+            if (engine.isGameOver()) {
+                engine = Engine<W, H>(t * N + lane);
+                checked.reset(lane, t * N + lane);
+            }
+        }
+    }
+    cout << "batch " << W << "x" << H << ": lockstep check  " << CHECK_TICKS << " ticks x " << N
+         << " lanes, " << rows << " rows cleared, all match Engine\n";
+    if (!rows) {
+        cout << "batch: lockstep check cleared no rows\n";
+        exit(1);
+    }
+}
+
+// Recording cost and size. Inputs are sparse, as from a person: a key on
+// about one tick in six. The same games are played with and without a
+// ReplayWriter, then the recording is decoded and replayed, which must
+// end on the same scores.
+template <int W>
+static void benchReplay() {
+    const long TICKS = 4000000;
+    const Input keys[] = {Input::Left, Input::Right, Input::Rotate, Input::SoftDrop, Input::HardDrop};
+    mt19937 rng(99);
+    vector<Input> script(TICKS);
+    for (Input& in : script) in = rng() % 6 == 0 ? keys[rng() % 5] : Input::None;
+
+    // Plays the script, restarting with the next seed whenever a game
+    // ends; returns the sum of final scores.
+    auto play = [&](ReplayWriter* writer) {
+        long total = 0, start = 0;
+        uint64_t seed = 1;
+        Engine<W, H> engine(seed);
+        if (writer) writer->begin(ReplayHeader{1, W, H, 0, seed, REPLAY_KEYFRAME_INTERVAL});
+        for (long t = 0; t < TICKS; ++t) {
+            if (writer && writer->wantsKeyframe(t - start))
+                writer->keyframe(t - start, &engine.snapshot(), 1);
+            if (writer) writer->input(t - start, 0, script[t]);
+            engine.step(script[t]);
+            if (engine.isGameOver()) {
+                total += engine.getScore();
+                ReplayResult result = resultOf(engine);
+                if (writer) writer->end(t + 1 - start, &result, 1);
+                engine = Engine<W, H>(++seed);
+                if (writer) writer->begin(ReplayHeader{1, W, H, 0, seed, REPLAY_KEYFRAME_INTERVAL});
+                start = t + 1;
+            }
+        }
+        ReplayResult result = resultOf(engine);
+        if (writer) writer->end(TICKS - start, &result, 1);
+        return total + engine.getScore();
+    };
+
+    auto start = chrono::steady_clock::now();
+    long plainScore = play(nullptr);
+    double plainSecs = secondsSince(start);
+
+    vector<uint8_t> data;
+    data.reserve(TICKS);
+    ReplayWriter writer(&data);
+    start = chrono::steady_clock::now();
+    long recordedScore = play(&writer);
+    double recordSecs = secondsSince(start);
+
+    long replayScore = 0, games = 0;
+    ReplayReader reader(data.data(), data.size());
+    ReplayHeader header;
+    while (reader.position() < data.data() + data.size()) {
+        if (!reader.header(header)) {
+            cout << "replay: bad header\n";
+            exit(1);
+        }
+        ReplayCursor<W, H> cursor(reader, header);
+        ReplayResult recorded;
+        bool ok = cursor.finish();
+        reader = cursor.getReader();
+        const Engine<W, H>& engine = cursor.getEngine(0);
+        if (!ok || !reader.result(recorded) || recorded.hash != engine.getHash()) {
+            cout << "replay: bad replay\n";
+            exit(1);
+        }
+        replayScore += engine.getScore();
+        games++;
+    }
+
+    cout << "replay " << W << "x" << H << ": " << games << " games, " << (double)data.size() / TICKS
+         << " bytes/tick, " << TICKS / plainSecs / 1e6 << " M ticks/s plain, "
+         << TICKS / recordSecs / 1e6 << " M ticks/s recording\n";
+    if (plainScore != recordedScore || plainScore != replayScore) {
+        cout << "replay: MISMATCH " << plainScore << " " << recordedScore << " " << replayScore << "\n";
+        exit(1);
+    }
+}
+
+// Seeking in a marathon replay: two hours at the starting speed (36,000
+// ticks), played by the greedy bot at a person's pace: it lines each
+// piece up as it appears and lets it fall instead of hard dropping. Each seek restores the nearest keyframe and simulates
+// forward; the state reached must match the one recorded at that tick.
+template <int W>
+static void benchSeek() {
+    const long TICKS = 36000;
+    const int SEEKS = 2000;
+    vector<uint8_t> data;
+    vector<uint64_t> hashes; // state before each tick
+    {
+        ReplayWriter writer(&data);
+        writer.begin(ReplayHeader{1, W, H, 0, 7, REPLAY_KEYFRAME_INTERVAL});
+        Engine<W, H> engine(7);
+        Input inputs[4 + W + 1];
+        long t = 0;
+        for (; t < TICKS && !engine.isGameOver(); ++t) {
+            hashes.push_back(engine.getHash());
+            if (writer.wantsKeyframe(t)) writer.keyframe(t, &engine.snapshot(), 1);
+            // Line the new piece up and let gravity bring it down.
+            int count = engine.getCurrent().getY() == 0 ? greedyInputs(engine, inputs) - 1 : 0;
+            for (int i = 0; i < count; ++i) writer.input(t, 0, inputs[i]);
+            engine.step(inputs, count);
+        }
+        hashes.push_back(engine.getHash());
+        ReplayResult result = resultOf(engine);
+        writer.end(t, &result, 1);
+    }
+
+    ReplayReader reader(data.data(), data.size());
+    ReplayHeader header;
+    reader.header(header);
+    ReplayCursor<W, H> cursor(reader, header);
+    auto start = chrono::steady_clock::now();
+    bool ok = cursor.index();
+    double indexSecs = secondsSince(start);
+    long ticks = cursor.getTicks();
+
+    start = chrono::steady_clock::now();
+    ReplayCursor<W, H> full(reader, header);
+    ok = ok && full.seek(0) && full.finish();
+    double fullSecs = secondsSince(start);
+
+    mt19937 rng(5);
+    start = chrono::steady_clock::now();
+    for (int n = 0; n < SEEKS && ok; ++n) {
+        long target = rng() % (ticks + 1);
+        ok = cursor.seek(target) && cursor.getEngine(0).getHash() == hashes[target];
+    }
+    double seekSecs = secondsSince(start);
+
+    cout << "seek " << W << "x" << H << ": " << ticks << " ticks, " << data.size() << " bytes ("
+         << (double)data.size() / ticks << " bytes/tick), index " << indexSecs * 1e3 << " ms, "
+         << "replay from start " << fullSecs * 1e3 << " ms, seek " << seekSecs / SEEKS * 1e6 << " us\n";
+    if (!ok) {
+        cout << "seek: MISMATCH\n";
+        exit(1);
+    }
+}
+
+// Move generation on ragged boards, for every piece type. Each placement's
+// path is then played on an Engine, which must lock the piece exactly
+// there; no two placements may leave the same board.
+template <int W>
+static void benchMovegen() {
+    const int BOARDS = 64, ROUNDS = 200;
+    mt19937 rng(4242);
+    vector<Grid<W, H>> boards = randomBoards<W>(rng, BOARDS);
+    static MoveGenerator<W, H> generator;
+    long searches = 0, placements = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (const Grid<W, H>& grid : boards)
+            for (int type = 0; type < 7; ++type) {
+                placements += generator.generate(grid, Tetromino((TetrominoType)type, W/2 - 2));
+                searches++;
+            }
+    double secs = secondsSince(start);
+
+    long tucks = 0;
+    bool ok = true;
+    Input path[256];
+    for (const Grid<W, H>& grid : boards)
+        for (int type = 0; type < 7 && ok; ++type) {
+            Tetromino spawn((TetrominoType)type, W/2 - 2);
+            int count = generator.generate(grid, spawn);
+            vector<uint64_t> seen;
+            for (int i = 0; i < count && ok; ++i) {
+                Tetromino piece = generator.piece(i);
+                Grid<W, H> expected = grid;
+                expected.merge(piece);
+                seen.push_back(expected.getHash());
+                expected.clearLines();
+
+                Engine<W, H> engine(1);
+                GameState<W, H> state = engine.snapshot();
+                state.grid = grid;
+                state.current = spawn;
+                engine.restore(state);
+                Events events = engine.step(path, generator.path(i, path));
+                ok = events.locked && engine.getGrid().getHash() == expected.getHash();
+                Tetromino dropped = piece;
+                dropped.setPosition(piece.getX(), 0);
+                tucks += grid.isCollision(dropped) || grid.dropY(dropped) != piece.getY();
+            }
+            sort(seen.begin(), seen.end());
+            ok = ok && adjacent_find(seen.begin(), seen.end()) == seen.end();
+        }
+
+    cout << "movegen " << W << "x" << H << ": " << searches / secs / 1e3 << " K searches/s ("
+         << secs / searches * 1e6 << " us), " << (double)placements / searches << " placements each, "
+         << (double)tucks * ROUNDS / searches << " reached only by soft drop\n";
+    if (!ok) {
+        cout << "movegen: MISMATCH\n";
+        exit(1);
+    }
+}
+
+// Perft, as chess engines use it: the number of distinct placement
+// sequences of a fixed piece sequence to a given depth, counted with the
+// move generator. The last ply is counted without playing it out. The
+// counts only change if the rules or the generator do, so a mismatch
+// against PERFT_COUNTS flags either.
+const int PERFT_MAX = 16;
+static MoveGenerator<10, H> perftGenerators[PERFT_MAX]; // one per ply
+
+static long perft(const Grid<10, H>& grid, const TetrominoType* pieces, int depth, long& searches) {
+    MoveGenerator<10, H>& generator = perftGenerators[depth - 1];
+    int count = generator.generate(grid, Tetromino(pieces[0], 10/2 - 2));
+    searches++;
+    if (depth == 1) return count;
+    long nodes = 0;
+    for (int i = 0; i < count; ++i) {
+        Grid<10, H> next = grid;
+        next.merge(generator.piece(i));
+        next.clearLines();
+        nodes += perft(next, pieces + 1, depth - 1, searches);
+    }
+    return nodes;
+}
+
+// Expected counts for depths 1-5 from the empty board and from a ragged
+// one, with the pieces seed 1 deals.
+const int PERFT_CHECKED = 5;
+const long PERFT_COUNTS[2][PERFT_CHECKED] = {
+    {17, 295, 10502, 99587, 3651414},
+    {19, 262, 5271, 32878, 359427},
+};
+
+static void benchPerft(int maxDepth) {
+    maxDepth = max(1, min(maxDepth, PERFT_MAX));
+    TetrominoType pieces[PERFT_MAX];
+    PieceQueue queue;
+    queue.reset(1);
+    for (TetrominoType& piece : pieces) piece = queue.draw();
+    mt19937 rng(2024);
+    const Grid<10, H> starts[2] = {Grid<10, H>(), randomBoards<10>(rng, 1)[0]};
+    const char* names[2] = {"empty", "ragged"};
+
+    bool ok = true;
+    for (int b = 0; b < 2; ++b) {
+        for (int depth = 1; depth <= maxDepth; ++depth) {
+            long searches = 0;
+            auto start = chrono::steady_clock::now();
+            long nodes = perft(starts[b], pieces, depth, searches);
+            double secs = secondsSince(start);
+            bool checked = depth <= PERFT_CHECKED;
+            bool match = !checked || nodes == PERFT_COUNTS[b][depth - 1];
+            ok = ok && match;
+            cout << "perft 10x" << H << " " << names[b] << " depth " << depth << ": " << nodes
+                 << " nodes, " << searches << " searches, " << nodes / secs / 1e6 << " M nodes/s"
+                 << (match ? "" : "  MISMATCH, expected " + to_string(PERFT_COUNTS[b][depth - 1])) << "\n";
+        }
+    }
+    if (!ok) exit(1);
+}
+
+// The bot's board features for one I piece dropped flat at the left of
+// an empty board, against counts worked out by hand. Fails on any
+// mismatch.
+template <int W>
+static void benchFeatures() {
+    Grid<W, H> grid;
+    Tetromino t(TetrominoType::I, 0);
+    t.setPosition(0, grid.dropY(t));
+    grid.merge(t);
+    BoardFeatures f = boardFeatures(grid);
+    // Every row has the two wall transitions; the bottom one has no more,
+    // as the piece touches the left wall. The columns under the piece
+    // change once at its top, the others once at the floor.
+    const int expected[6] = {4, 1, 0, 0, 2 * H, W};
+    const int got[6] = {f.aggregate, f.bumpiness, f.holes, f.wells, f.rowTransitions, f.columnTransitions};
+    const char* names[6] = {"aggregate", "bumpiness", "holes", "wells", "row transitions", "column transitions"};
+    bool ok = true;
+    for (int i = 0; i < 6; ++i) {
+        bool match = got[i] == expected[i];
+        ok = ok && match;
+        cout << "features " << W << "x" << H << " " << names[i] << ": " << got[i]
+             << (match ? "" : "  MISMATCH, expected " + to_string(expected[i])) << "\n";
+    }
+    if (!ok) exit(1);
+}
+
+// MCTS rollout throughput by thread count, doubling up to one per core:
+// the same 20 moves of one game, 2,000 iterations each.
+template <int W>
+static void benchMcts() {
+    int cores = max(1u, thread::hardware_concurrency());
+    double single = 0;
+    for (int threads = 1; ; threads = min(threads * 2, cores)) {
+        MctsOptions options;
+        options.iterations = 2000;
+        options.threads = threads;
+        MctsBot<W, H> bot(options);
+        Engine<W, H> engine(1);
+        Input inputs[BOT_MAX_INPUTS];
+        auto start = chrono::steady_clock::now();
+        for (int move = 0; move < 20 && !engine.isGameOver(); ++move)
+            engine.step(inputs, bot.choose(engine, inputs));
+        double rate = bot.getRollouts() / secondsSince(start);
+        if (threads == 1) single = rate;
+        cout << "mcts " << W << "x" << H << ", " << threads << " threads: " << rate / 1e3 << " K rollouts/s ("
+             << rate / single << "x one thread), score " << engine.getScore() << "\n";
+        if (threads == cores) break;
+    }
+}
+
+int main(int argc, char** argv) {
+    string which = argc > 1 ? argv[1] : "all";
+    if (which == "all" || which == "collision") {
+        benchCollision<4>();
+        benchCollision<10>();
+        benchCollision<40>();
+    }
+    if (which == "all" || which == "snapshot") {
+        benchSnapshot<4>();
+        benchSnapshot<10>();
+        benchSnapshot<40>();
+    }
+    if (which == "all" || which == "step") {
+        benchStep<4>();
+        benchStep<10>();
+        benchStep<40>();
+    }
+    if (which == "all" || which == "batch") {
+        benchBatch<4>();
+        benchBatch<10>();
+    }
+    if (which == "all" || which == "replay") {
+        benchReplay<4>();
+        benchReplay<10>();
+        benchReplay<40>();
+    }
+    if (which == "all" || which == "seek") {
+        benchSeek<10>();
+    }
+    if (which == "all" || which == "movegen") {
+        benchMovegen<4>();
+        benchMovegen<10>();
+        benchMovegen<40>();
+    }
+    if (which == "all" || which == "perft") {
+        benchPerft(argc > 2 ? atoi(argv[2]) : PERFT_CHECKED);
+    }
+    if (which == "all" || which == "features") {
+        benchFeatures<10>();
+    }
+    if (which == "all" || which == "mcts") {
+        benchMcts<10>();
+    }
+    return 0;
+}
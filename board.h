@@ -0,0 +1,326 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+// Tetromino and Grid, shared by the single player (tetris.cpp) and
+// multiplayer (tetrisX2.cpp) front-ends.
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
+using namespace std;
+
+// Standard board size; other sizes are separate Grid instantiations.
+#define DEFAULT_WIDTH 10
+#define DEFAULT_HEIGHT 22
+#define BLOCK "\u2588\u2588"
+#define GHOST "\u2591\u2591"
+#define EMPTY "  "
+
+enum class TetrominoType { I, O, T, S, Z, J, L };
+
+// One letter per TetrominoType, for previews and logs.
+const char PIECE_NAMES[] = "IOTSZJL";
+
+// ANSI color codes
+#define ANSI_COLOR_RESET   "\x1b[0m"
+#define ANSI_COLOR_CYAN    "\x1b[36m"
+#define ANSI_COLOR_YELLOW  "\x1b[33m"
+#define ANSI_COLOR_MAGENTA "\x1b[35m"
+#define ANSI_COLOR_GREEN   "\x1b[32m"
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_BLUE    "\x1b[34m"
+#define ANSI_COLOR_ORANGE  "\x1b[38;5;208m"
+#define ANSI_COLOR_WHITE   "\x1b[37m"
+#define ANSI_COLOR_GHOST   "\x1b[37;2m"
+
+// Every rotation state of every piece, precomputed at compile time as a
+// 4x4 bitmask: bit (i*4 + j) is row i, column j of the piece's box.
+// Rotation is clockwise inside the piece's own n x n box, as before.
+// bottom[][][j] is the lowest occupied row of box column j, or NO_CELL.
+const int NO_CELL = -64;
+
+struct ShapeTable {
+    uint16_t cells[7][4];
+    int8_t bottom[7][4][4];
+};
+
+constexpr uint16_t rotateClockwise(uint16_t shape, int n) {
+    uint16_t rotated = 0;
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            if ((shape >> (i*4 + j)) & 1)
+                rotated |= 1u << (j*4 + n-1-i);
+    return rotated;
+}
+
+constexpr ShapeTable buildShapeTable() {
+    //                        I       O       T       S       Z       J       L
+    const uint16_t spawn[7] = {0x00F0, 0x0033, 0x0072, 0x0036, 0x0063, 0x0071, 0x0074};
+    const int box[7]        = {4,      2,      3,      3,      3,      3,      3};
+    ShapeTable table = {};
+    for (int t = 0; t < 7; ++t) {
+        table.cells[t][0] = spawn[t];
+        for (int r = 1; r < 4; ++r)
+            table.cells[t][r] = rotateClockwise(table.cells[t][r-1], box[t]);
+        for (int r = 0; r < 4; ++r)
+            for (int j = 0; j < 4; ++j) {
+                table.bottom[t][r][j] = NO_CELL;
+                for (int i = 0; i < 4; ++i)
+                    if ((table.cells[t][r] >> (i*4 + j)) & 1) table.bottom[t][r][j] = i;
+            }
+    }
+    return table;
+}
+
+constexpr ShapeTable SHAPES = buildShapeTable();
+
+// Cells hold a one-byte palette index: 0 is empty, 1-7 are the pieces in
+// TetrominoType order and CELL_GHOST marks the ghost piece. Only the
+// renderers turn an index into its escape sequence through PALETTE.
+const uint8_t CELL_EMPTY = 0;
+const uint8_t CELL_GHOST = 8;
+
+static const char* const PALETTE[9] = {
+    "", ANSI_COLOR_CYAN, ANSI_COLOR_YELLOW, ANSI_COLOR_MAGENTA, ANSI_COLOR_GREEN,
+    ANSI_COLOR_RED, ANSI_COLOR_BLUE, ANSI_COLOR_ORANGE, ANSI_COLOR_GHOST
+};
+
+// A piece is just {type, rotation, x, y}; its cells come from SHAPES, so
+// copying, rotating and trial moves never allocate.
+class Tetromino {
+private:
+    TetrominoType type;
+    int rotation;
+    int x, y;
+
+public:
+    Tetromino(TetrominoType t, int startX) : type(t), rotation(0), x(startX), y(0) {}
+
+    void rotate() { rotation = (rotation + 1) & 3; }
+
+    // 4x4 cell mask of the current rotation state.
+    uint16_t getShape() const { return SHAPES.cells[(int)type][rotation]; }
+    // Cells of row i of the piece's box, bit j = column j.
+    unsigned getRowBits(int i) const { return (getShape() >> (i*4)) & 0xF; }
+    bool isCell(int i, int j) const { return (getShape() >> (i*4 + j)) & 1; }
+    // Lowest occupied row of box column j, or NO_CELL if the column is empty.
+    int getBottom(int j) const { return SHAPES.bottom[(int)type][rotation][j]; }
+
+    TetrominoType getType() const { return type; }
+    int getRotation() const { return rotation; }
+    int getX() const { return x; }
+    int getY() const { return y; }
+    uint8_t getColor() const { return (uint8_t)type + 1; }
+    void move(int dx, int dy) { x += dx; y += dy; }
+    void setPosition(int newX, int newY) { x = newX; y = newY; }
+};
+
+static_assert(is_trivially_copyable<Tetromino>::value, "Tetromino must stay a plain value");
+
+// splitmix64 finaliser: maps a feature id to a well-mixed 64-bit key.
+constexpr uint64_t mix64(uint64_t z) {
+    z += 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Zobrist key of a piece state, combined with Grid::getHash by hashWith.
+inline uint64_t pieceKey(const Tetromino& t) {
+    uint64_t id = ((uint64_t)t.getType() << 2 | t.getRotation()) << 32
+                | (uint32_t)(t.getX() + 1024) << 16 | (uint32_t)(t.getY() + 1024);
+    return mix64(id ^ 0x5049454345000000ull);
+}
+
+// Row storage for a board W cells wide: the narrowest unsigned type that
+// holds the cells plus the PAD-bit left wall, so a 4-wide training board
+// uses uint8_t, the standard board uint16_t and co-op boards up to 60
+// wide uint64_t. WideRow is a type with room for a piece shifted past the
+// right edge, used only inside the collision kernel.
+const int ROW_PAD = 4;
+
+template <int W>
+using RowFor = typename conditional<W + ROW_PAD <= 8,  uint8_t,
+               typename conditional<W + ROW_PAD <= 16, uint16_t,
+               typename conditional<W + ROW_PAD <= 32, uint32_t,
+                                                       uint64_t>::type>::type>::type;
+
+template <class Row> struct WideRow           { typedef uint64_t type; };
+template <>          struct WideRow<uint64_t> { typedef unsigned __int128 type; };
+
+// Bitboard grid: one occupancy mask per row, so a standard board fits in
+// a single cache line. Each stored row is padded with sentinel bits:
+//   bits [0, PAD)             left wall
+//   bits [PAD, PAD+W)         cells, column x at bit x+PAD
+//   bits [PAD+W, ...)         right wall
+// TOP rows above the board hold only the walls and FLOOR rows below it are
+// solid, so a collision test is a handful of shifts and ANDs with no
+// bounds checks. Colours live in a separate plane of palette indices that
+// only the renderer reads.
+//
+// heights[] tracks each column's surface (rows from the floor up to its
+// highest filled cell) so dropY can find where a piece lands without
+// stepping down row by row. It is padded by PAD zero entries on both sides
+// so empty piece columns past the walls can be read without a branch.
+//
+// hash is a Zobrist key of the occupied cells: the XOR of rowKey(y, cells)
+// over all rows, where an empty row contributes 0. merge and clearLines
+// XOR out the old key and XOR in the new one for each row they touch, so
+// the key is never rebuilt from scratch.
+template <int W, int H>
+class Grid {
+public:
+    typedef RowFor<W> Row;
+
+private:
+    typedef typename WideRow<Row>::type Wide;
+
+    static_assert(W >= 4 && W + ROW_PAD <= 64, "board must be 4 to 60 cells wide");
+    static_assert(H >= 4 && H <= 32, "clearLines reports rows in a 32-bit mask");
+
+    static const int PAD = ROW_PAD;
+    static const int TOP = 4;
+    static const int FLOOR = 4;
+    static constexpr Row FULL_ROW = (Row)(((uint64_t)1 << W) - 1);
+    static constexpr Row WALLS = (Row)~((Row)FULL_ROW << PAD);
+    static constexpr Row SOLID = (Row)~(Row)0;
+    static constexpr Wide OUTSIDE = ~(Wide)SOLID;
+
+    alignas(64) Row rows[TOP + H + FLOOR];
+    uint8_t heights[PAD + W + PAD];
+    uint8_t colors[H][W];
+    uint64_t hash;
+
+    void recomputeHeights() {
+        memset(heights, 0, sizeof(heights));
+        Row seen = 0;
+        for (int y = 0; y < H && seen != FULL_ROW; ++y) {
+            Row fresh = getRow(y) & ~seen;
+            seen |= fresh;
+            for (; fresh; fresh &= fresh - 1)
+                heights[PAD + __builtin_ctzll(fresh)] = H - y;
+        }
+    }
+
+public:
+    Grid() {
+        for (int y = 0; y < TOP + H; ++y) rows[y] = WALLS;
+        for (int y = TOP + H; y < TOP + H + FLOOR; ++y) rows[y] = SOLID;
+        memset(heights, 0, sizeof(heights));
+        memset(colors, 0, sizeof(colors));
+        hash = 0;
+    }
+
+    // Rebuilds the grid from a plane of palette indices (0 = empty), as
+    // getColor reports them: rows, heights and hash follow from it.
+    void load(const uint8_t (&cells)[H][W]) {
+        hash = 0;
+        for (int y = 0; y < H; ++y) {
+            Row row = 0;
+            for (int x = 0; x < W; ++x)
+                if (cells[y][x]) row |= (Row)((Row)1 << x);
+            rows[TOP + y] = WALLS | (Row)(row << PAD);
+            hash ^= rowKey(y, row);
+        }
+        memcpy(colors, cells, sizeof(colors));
+        recomputeHeights();
+    }
+
+    // Key of row y holding the given cells; 0 for an empty row.
+    static uint64_t rowKey(int y, Row cells) {
+        return cells ? mix64(mix64(cells) ^ (uint64_t)y) : 0;
+    }
+
+    // Shifts each row of the piece to its column and ANDs it against the
+    // padded board. x and y are clamped into the padded area first; the
+    // clamped position collides exactly when the real one would, since
+    // everything past the clamp is wall or floor. Bits shifted beyond the
+    // stored row hit the OUTSIDE sentinel.
+    bool isCollision(const Tetromino& t) const {
+        int y = min(max(t.getY(), -TOP), H);
+        int shift = min(max(t.getX() + PAD, 0), W + PAD);
+        const Row* r = rows + TOP + y;
+        uint16_t shape = t.getShape();
+        Wide hit = ((Wide)((shape      ) & 0xF) << shift & (r[0] | OUTSIDE))
+                 | ((Wide)((shape >>  4) & 0xF) << shift & (r[1] | OUTSIDE))
+                 | ((Wide)((shape >>  8) & 0xF) << shift & (r[2] | OUTSIDE))
+                 | ((Wide)((shape >> 12) & 0xF) << shift & (r[3] | OUTSIDE));
+        return hit != 0;
+    }
+
+    void merge(const Tetromino& t) {
+        for (int i = 0; i < 4; ++i) {
+            int y = t.getY() + i;
+            if (y < 0 || t.getRowBits(i) == 0) continue;
+            Row before = getRow(y);
+            rows[TOP + y] |= (Row)((Row)t.getRowBits(i) << (t.getX() + PAD));
+            hash ^= rowKey(y, before) ^ rowKey(y, getRow(y));
+            for (int j = 0; j < 4; ++j) {
+                if (t.isCell(i, j)) {
+                    int x = t.getX() + j;
+                    colors[y][x] = t.getColor();
+                    heights[PAD + x] = max<int>(heights[PAD + x], H - y);
+                }
+            }
+        }
+    }
+
+    // Row the piece comes to rest on if dropped straight down from where it
+    // is. When the piece is above the stack in all of its columns, each
+    // column allows a drop to just above its surface and the answer is the
+    // smallest of those. Only a piece tucked under an overhang falls back
+    // to stepping down one row at a time.
+    int dropY(const Tetromino& t) const {
+        const uint8_t* h = heights + PAD + min(max(t.getX(), -PAD), W);
+        int land = H;
+        for (int j = 0; j < 4; ++j)
+            land = min(land, H - h[j] - 1 - t.getBottom(j));
+        if (land >= t.getY()) return land;
+
+        Tetromino next = t;
+        next.move(0, 1);
+        while (!isCollision(next)) next.move(0, 1);
+        return next.getY() - 1;
+    }
+
+    // Removes every full row in one bottom-up pass: rows that survive are
+    // copied down over the cleared ones and the freed rows at the top are
+    // reset. Returns a mask of the cleared rows (bit y = row y before the
+    // clear) so callers can score or animate them without rescanning.
+    uint32_t clearLines() {
+        uint32_t cleared = 0;
+        int write = H - 1;
+        for (int y = H - 1; y >= 0; --y) {
+            if (rows[TOP + y] == SOLID) {
+                cleared |= 1u << y;
+                hash ^= rowKey(y, FULL_ROW);
+                continue;
+            }
+            if (write != y) {
+                hash ^= rowKey(y, getRow(y)) ^ rowKey(write, getRow(y));
+                rows[TOP + write] = rows[TOP + y];
+                memcpy(colors[write], colors[y], sizeof(colors[0]));
+            }
+            write--;
+        }
+        if (cleared == 0) return 0;
+
+        for (; write >= 0; --write) {
+            rows[TOP + write] = WALLS;
+            memset(colors[write], 0, sizeof(colors[0]));
+        }
+        recomputeHeights();
+        return cleared;
+    }
+
+    // Occupancy of row y without the sentinels, bit x = column x.
+    Row getRow(int y) const { return (Row)(rows[TOP + y] >> PAD) & FULL_ROW; }
+    int getHeight(int x) const { return heights[PAD + x]; }
+    uint64_t getHash() const { return hash; }
+    // Key of this board with t as the active piece.
+    uint64_t hashWith(const Tetromino& t) const { return hash ^ pieceKey(t); }
+    uint8_t getColor(int x, int y) const { return colors[y][x]; }
+};
+
+#endif
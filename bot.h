@@ -0,0 +1,363 @@
+#ifndef BOT_H
+#define BOT_H
+
+// Built-in players that drive an Engine through the same Inputs a person
+// would send.
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include "engine.h"
+#include "movegen.h"
+
+// Most inputs the bot sends in one tick: a replay holds at most 32 per
+// player per tick, and tetrisX2 may add pause or quit to the bot's own.
+#define BOT_MAX_INPUTS 24
+
+// Shape of a board for the bot's evaluation. Every feature comes from the
+// row masks with a popcount per row, or from the column heights Grid
+// already keeps, never from a walk over the cells.
+struct BoardFeatures {
+    int aggregate;         // sum of column heights
+    int bumpiness;         // sum of height steps between neighbouring columns
+    int holes;             // empty cells with a filled cell somewhere above
+    int wells;             // empty cells walled in on both sides, deeper ones counting more
+    int rowTransitions;    // filled/empty changes along each row, walls filled
+    int columnTransitions; // filled/empty changes down each column, floor filled
+};
+
+template <int W, int H>
+BoardFeatures boardFeatures(const Grid<W, H>& grid) {
+    const uint64_t full = ((uint64_t)1 << W) - 1;
+    BoardFeatures f = {0, 0, 0, 0, 0, 0};
+    for (int x = 0; x < W; ++x) {
+        f.aggregate += grid.getHeight(x);
+        if (x > 0) f.bumpiness += abs(grid.getHeight(x) - grid.getHeight(x - 1));
+    }
+    // Rows above the highest column are empty and add the same to every
+    // board: two row transitions each, nothing else.
+    int top = H;
+    for (int x = 0; x < W; ++x) top = min(top, H - grid.getHeight(x));
+    f.rowTransitions = 2 * top;
+
+    uint64_t above = 0, cover = 0, well1 = 0, well2 = 0;
+    for (int y = top; y < H; ++y) {
+        uint64_t row = grid.getRow(y);
+        uint64_t walled = row << 1 | 1 | (uint64_t)1 << (W + 1);
+        f.rowTransitions += __builtin_popcountll((walled ^ walled >> 1) & ((2ull << W) - 1));
+        f.columnTransitions += __builtin_popcountll(row ^ above);
+        f.holes += __builtin_popcountll(cover & ~row);
+        // A well cell counts once more for each of up to two well cells
+        // straight above it.
+        uint64_t well = ~row & full & (row << 1 | 1) & (row >> 1 | (uint64_t)1 << (W - 1));
+        f.wells += __builtin_popcountll(well) + __builtin_popcountll(well & well1)
+                 + __builtin_popcountll(well & well1 & well2);
+        well2 = well1;
+        well1 = well;
+        cover |= row;
+        above = row;
+    }
+    f.columnTransitions += __builtin_popcountll(above ^ full);
+    return f;
+}
+
+// The bot's weighting of a board's features and the lines cleared
+// reaching it; higher is better.
+inline double scoreBoard(const BoardFeatures& f, int lines) {
+    return 0.76 * lines - 0.51 * f.aggregate - 0.18 * f.bumpiness - 3.5 * f.holes
+         - 0.9 * f.wells - 0.6 * f.rowTransitions - 1.0 * f.columnTransitions;
+}
+
+// Greedy policy: try every rotation and column for the current piece,
+// drop it, and send the inputs for the placement scoreBoard likes best
+// followed by a hard drop, all in one tick. Cheaper than Bot, which also
+// finds placements reached by soft drops and tucks.
+template <int W, int H>
+int greedyInputs(const Engine<W, H>& engine, Input* inputs) {
+    const Grid<W, H>& grid = engine.getGrid();
+    Tetromino spawn = engine.getCurrent();
+    double best = -1e18;
+    int bestRot = 0, bestX = spawn.getX();
+
+    Tetromino rotated = spawn;
+    for (int r = 0; r < 4; ++r, rotated.rotate()) {
+        for (int x = -3; x < W; ++x) {
+            Tetromino t = rotated;
+            t.setPosition(x, spawn.getY());
+            if (grid.isCollision(t)) continue;
+            t.setPosition(x, grid.dropY(t));
+            Grid<W, H> after = grid;
+            after.merge(t);
+            double score = scoreBoard(boardFeatures(after), __builtin_popcount(after.clearLines()));
+            if (score > best) { best = score; bestRot = r; bestX = x; }
+        }
+    }
+
+    int count = 0;
+    for (int r = 0; r < bestRot; ++r) inputs[count++] = Input::Rotate;
+    for (int dx = bestX - spawn.getX(); dx != 0; dx += dx < 0 ? 1 : -1)
+        inputs[count++] = dx < 0 ? Input::Left : Input::Right;
+    inputs[count++] = Input::HardDrop;
+    return count;
+}
+
+// How far and how wide the bot looks. With depth 1 it plays the best
+// placement of the current piece alone. Deeper, it runs a beam search
+// through the next depth - 1 pieces of the preview, keeping the width
+// best-scoring boards after each piece and playing the first placement of
+// the best board at the end. Each layer's boards are expanded by threads
+// workers, the calling thread among them. With a budget, a layer still
+// running when the time is up is dropped and the bot plays what the last
+// finished layer found, so a slow machine plays weaker rather than later.
+struct BotOptions {
+    int depth = 1;     // pieces searched, 1 to PREVIEW + 1
+    int width = 32;    // boards kept after each piece
+    int threads = 1;
+    int budgetMs = 0;  // per move, on top of the current piece's search; 0 = none
+};
+
+// Search for a bot playing live against the frame loop: three pieces deep
+// on every core, for at most 50 ms a move.
+inline BotOptions liveBotOptions() {
+    BotOptions options;
+    options.depth = 3;
+    options.threads = max(1u, thread::hardware_concurrency());
+    options.budgetMs = 50;
+    return options;
+}
+
+// A live bot's budget for a move in a frame of frameUsec: its own, cut to
+// a quarter of the frame. The search runs on the frame thread, so at high
+// levels a full budget would slow gravity for everyone on screen.
+inline int liveBudgetMs(int budgetMs, long frameUsec) {
+    int cap = (int)max(1L, frameUsec / 4000);
+    return budgetMs > 0 ? min(budgetMs, cap) : cap;
+}
+
+// Heuristic bot: tries every placement the move generator finds for the
+// current piece (and, searching deeper, for the pieces after it) and
+// picks the one whose board, after line clears, scores best on the
+// weighted features. Not copyable: it owns its worker threads.
+template <int W, int H>
+class Bot {
+private:
+    static const int MAX_PLACEMENTS = 4 * H * W;
+
+    // A board in the beam.
+    struct Node {
+        Grid<W, H> grid;
+        int lines;     // cleared since the current piece
+        int root;      // placement of the current piece it came from
+        double value;
+    };
+
+    // A placement found expanding the beam, kept small until it makes the cut.
+    struct Child {
+        Tetromino piece = Tetromino(TetrominoType::I, 0);
+        double value;
+        int parent;    // node in the beam, or placement for the current piece
+    };
+
+    BotOptions options;
+    MoveGenerator<W, H> generator;          // the current piece's search; paths come from it
+    vector<MoveGenerator<W, H>> searchers;  // one per worker
+    vector<Node> beam, nextBeam;
+    int beamCount;
+    vector<Child> children;                 // MAX_PLACEMENTS slots per node in the beam
+    vector<int> childCounts;
+    vector<Child*> ranked;
+
+    // Worker pool: each layer is a new generation, and workers take nodes
+    // from nextNode until there are none left or the deadline passes.
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake, finished;
+    long generation;
+    int busy;
+    bool stopping;
+    atomic<int> nextNode;
+    atomic<bool> timedOut;
+    TetrominoType expanding;                // the piece this layer places
+    chrono::steady_clock::time_point deadline;
+
+    // Expands nodes of the beam with the piece `expanding` into their
+    // children slots. A node whose piece cannot spawn has no children.
+    void expand(MoveGenerator<W, H>& search) {
+        for (int n; (n = nextNode++) < beamCount; ) {
+            if (chrono::steady_clock::now() > deadline) {
+                timedOut = true;
+                return;
+            }
+            const Node& node = beam[n];
+            Child* out = &children[(size_t)n * MAX_PLACEMENTS];
+            int count = 0;
+            Tetromino spawn(expanding, W / 2 - 2);
+            if (!node.grid.isCollision(spawn)) {
+                int placements = search.generate(node.grid, spawn);
+                for (int i = 0; i < placements; ++i) {
+                    Grid<W, H> after = node.grid;
+                    after.merge(search.piece(i));
+                    int lines = node.lines + __builtin_popcount(after.clearLines());
+                    out[count++] = Child{search.piece(i), scoreBoard(boardFeatures(after), lines), n};
+                }
+            }
+            childCounts[n] = count;
+        }
+    }
+
+    void work(int w) {
+        long seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            expand(searchers[w]);
+            lock_guard<mutex> guard(lock);
+            if (--busy == 0) finished.notify_one();
+        }
+    }
+
+    // One layer of the search on every thread; returns when all are done.
+    void expandAll() {
+        nextNode = 0;
+        {
+            lock_guard<mutex> guard(lock);
+            generation++;
+            busy = (int)workers.size();
+        }
+        wake.notify_all();
+        expand(searchers[0]);
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [&] { return busy == 0; });
+    }
+
+    // Replaces the beam with the best width of ranked[0, total), each
+    // rebuilt on its parent's board; with no parent beam (the current
+    // piece's layer) the board is grid and the parent is the root.
+    void keepBest(int total, const Grid<W, H>& grid, bool fromBeam) {
+        int kept = min(total, options.width);
+        nth_element(ranked.begin(), ranked.begin() + kept, ranked.begin() + total,
+                    [](const Child* a, const Child* b) { return a->value > b->value; });
+        for (int j = 0; j < kept; ++j) {
+            const Child& c = *ranked[j];
+            Node& node = nextBeam[j];
+            node.grid = fromBeam ? beam[c.parent].grid : grid;
+            node.grid.merge(c.piece);
+            node.lines = (fromBeam ? beam[c.parent].lines : 0) + __builtin_popcount(node.grid.clearLines());
+            node.root = fromBeam ? beam[c.parent].root : c.parent;
+            node.value = c.value;
+        }
+        swap(beam, nextBeam);
+        beamCount = kept;
+    }
+
+    int bestRoot() const {
+        int best = 0;
+        for (int n = 1; n < beamCount; ++n)
+            if (beam[n].value > beam[best].value) best = n;
+        return beam[best].root;
+    }
+
+    // Beam search from the current piece's placements, already generated.
+    // Returns the placement to play.
+    int search(const Engine<W, H>& engine) {
+        const Grid<W, H>& grid = engine.getGrid();
+        int total = 0;
+        for (int i = 0; i < generator.getCount(); ++i) {
+            if (generator.placement(i).length > BOT_MAX_INPUTS) continue;
+            Grid<W, H> after = grid;
+            after.merge(generator.piece(i));
+            int lines = __builtin_popcount(after.clearLines());
+            children[total] = Child{generator.piece(i), scoreBoard(boardFeatures(after), lines), i};
+            ranked[total] = &children[total];
+            total++;
+        }
+        if (!total) return -1;
+        keepBest(total, grid, false);
+        int best = bestRoot();
+
+        for (int d = 1; d < options.depth; ++d) {
+            expanding = engine.getNext(d - 1);
+            timedOut = false;
+            expandAll();
+            if (timedOut) break;
+            total = 0;
+            for (int n = 0; n < beamCount; ++n)
+                for (int k = 0; k < childCounts[n]; ++k) ranked[total++] = &children[(size_t)n * MAX_PLACEMENTS + k];
+            if (!total) break; // every line tops out; play the last layer's best
+            keepBest(total, grid, true);
+            best = bestRoot();
+        }
+        return best;
+    }
+
+public:
+    explicit Bot(const BotOptions& opts = BotOptions())
+        : options(opts), beamCount(0), generation(0), busy(0), stopping(false), nextNode(0),
+          timedOut(false), expanding(TetrominoType::I) {
+        options.depth = max(1, min(options.depth, PREVIEW + 1));
+        options.width = max(1, options.width);
+        options.threads = max(1, options.threads);
+        if (options.depth == 1) return;
+        searchers.resize(options.threads);
+        beam.resize(options.width);
+        nextBeam.resize(options.width);
+        children.resize((size_t)options.width * MAX_PLACEMENTS);
+        childCounts.resize(options.width);
+        ranked.resize(children.size());
+        for (int w = 1; w < options.threads; ++w) workers.emplace_back(&Bot::work, this, w);
+    }
+
+    const BotOptions& getOptions() const { return options; }
+
+    Bot(const Bot&) = delete;
+    Bot& operator=(const Bot&) = delete;
+
+    ~Bot() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers) worker.join();
+    }
+
+    // The inputs for the best placement of the current piece, to be sent
+    // in one step() whose gravity locks it there. Returns how many (at
+    // most BOT_MAX_INPUTS); 0 when the game is over or paused, or the
+    // piece has nowhere to go.
+    int choose(const Engine<W, H>& engine, Input* out) { return choose(engine, out, options.budgetMs); }
+
+    // As above, with budgetMs in place of the options' budget for this move.
+    int choose(const Engine<W, H>& engine, Input* out, int budgetMs) {
+        if (engine.isGameOver() || engine.isPaused()) return 0;
+        deadline = budgetMs > 0 ? chrono::steady_clock::now() + chrono::milliseconds(budgetMs)
+                                : chrono::steady_clock::time_point::max();
+        const Grid<W, H>& grid = engine.getGrid();
+        int count = generator.generate(grid, engine.getCurrent());
+        int best = -1;
+        if (options.depth > 1) {
+            best = search(engine);
+        } else {
+            double bestScore = -1e18;
+            for (int i = 0; i < count; ++i) {
+                if (generator.placement(i).length > BOT_MAX_INPUTS) continue;
+                Grid<W, H> after = grid;
+                after.merge(generator.piece(i));
+                int lines = __builtin_popcount(after.clearLines());
+                double s = scoreBoard(boardFeatures(after), lines);
+                if (s > bestScore) { bestScore = s; best = i; }
+            }
+        }
+        return best < 0 ? 0 : generator.path(best, out);
+    }
+};
+
+#endif
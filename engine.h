@@ -0,0 +1,242 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+// Headless game rules: one board advanced a tick at a time through
+// step(), with no terminal, timing or sound. tetris.cpp and tetrisX2.cpp
+// drive it from the keyboard; tools can drive it directly.
+
+#include "board.h"
+
+// Small per-game PRNG (splitmix64). Each game owns one, seeded
+// explicitly, so its piece sequence depends only on the seed, is part of
+// its state and survives snapshot/restore.
+struct Rng {
+    uint64_t state;
+
+    uint32_t next() {
+        uint64_t z = mix64(state);
+        state += 0x9E3779B97F4A7C15ull;
+        return (uint32_t)(z >> 32);
+    }
+
+    // Uniform in [0, n) by multiply-shift; no division.
+    uint32_t below(uint32_t n) { return (uint32_t)(((uint64_t)next() * n) >> 32); }
+};
+
+// Number of upcoming pieces the queue exposes.
+#define PREVIEW 5
+
+// 7-bag randomizer: every run of seven pieces is a shuffle of all seven
+// types, so no piece is missing for more than 12 in a row. The next
+// PREVIEW pieces sit in a fixed ring buffer; drawing one refills its slot
+// from the bag. Plain data, so it is saved along with the rest of the game.
+struct PieceQueue {
+    Rng rng;
+    uint8_t bag[7];
+    uint8_t bagLeft;        // unused pieces at the front of bag
+    uint8_t ring[PREVIEW];
+    uint8_t head;           // slot of the next piece
+
+    void reset(uint64_t seed) {
+        rng = Rng{seed};
+        bagLeft = 0;
+        head = 0;
+        for (int i = 0; i < PREVIEW; ++i) ring[i] = fromBag();
+    }
+
+    // The piece i draws from now; peek(0) is the next one.
+    TetrominoType peek(int i) const { return (TetrominoType)ring[(head + i) % PREVIEW]; }
+
+    TetrominoType draw() {
+        TetrominoType t = (TetrominoType)ring[head];
+        ring[head] = fromBag();
+        head = (head + 1) % PREVIEW;
+        return t;
+    }
+
+    // Deals the pieces after the preview from another shuffle: the rest
+    // of the current bag in a new order, then bags drawn from seed. What
+    // a player can see does not change; for search that must not peek.
+    void reshuffle(uint64_t seed) {
+        rng = Rng{seed};
+        for (int i = bagLeft - 1; i > 0; --i) swap(bag[i], bag[rng.below(i + 1)]);
+    }
+
+private:
+    uint8_t fromBag() {
+        if (bagLeft == 0) {
+            for (int i = 0; i < 7; ++i) bag[i] = i;
+            for (int i = 6; i > 0; --i) swap(bag[i], bag[rng.below(i + 1)]);
+            bagLeft = 7;
+        }
+        return bag[--bagLeft];
+    }
+};
+
+// Everything needed to resume a game exactly: board, active piece, piece
+// queue, score, lines and flags. It is plain data, so snapshot/restore is one memcpy.
+template <int W, int H>
+struct GameState {
+    Grid<W, H> grid;
+    Tetromino current;
+    PieceQueue queue;
+    int score;
+    int lines;
+    int level;
+    bool gameOver;
+    bool paused;
+};
+
+static_assert(is_trivially_copyable<GameState<DEFAULT_WIDTH, DEFAULT_HEIGHT>>::value,
+              "GameState must stay memcpy-able");
+
+// One player action. A tick applies any number of them, in order, and
+// then lets gravity act.
+enum class Input : uint8_t { None, Left, Right, Rotate, SoftDrop, HardDrop, Pause, Quit };
+
+// What happened during a tick, for the front-end's sounds and bookkeeping.
+struct Events {
+    bool locked;       // the falling piece locked into the grid
+    uint32_t cleared;  // rows cleared by that lock, bit y = row y
+    bool gameOver;     // the game ended during this tick
+};
+
+// Piece seed of player 1 or 2 in a versus match. With samePieces both are
+// dealt the identical sequence; otherwise each gets its own stream.
+inline uint64_t versusSeed(uint64_t matchSeed, int playerId, bool samePieces) {
+    return mix64(matchSeed + (samePieces ? 0 : playerId));
+}
+
+template <int W, int H>
+class Engine {
+private:
+    GameState<W, H> state;
+    bool topRowEndsGame; // versus rule: any block left in row 0 ends the game
+
+    Tetromino newPiece() {
+        return Tetromino(state.queue.draw(), W/2 - 2);
+    }
+
+    void apply(Input input) {
+        if (state.gameOver) return;
+        if (state.paused) {
+            if (input == Input::Pause) state.paused = false;
+            return;
+        }
+
+        Tetromino temp = state.current;
+        switch (input) {
+            case Input::Left:     temp.move(-1, 0); break;
+            case Input::Right:    temp.move(1, 0); break;
+            case Input::Rotate:   temp.rotate(); break;
+            case Input::SoftDrop: temp.move(0, 1); break;
+            case Input::HardDrop: temp.setPosition(temp.getX(), state.grid.dropY(temp)); break;
+            case Input::Pause:    state.paused = true; return;
+            case Input::Quit:     state.gameOver = true; return;
+            case Input::None:     return;
+        }
+        if (!state.grid.isCollision(temp)) state.current = temp;
+    }
+
+    void gravity(Events& events) {
+        if (state.paused || state.gameOver) return;
+        Tetromino temp = state.current;
+        temp.move(0, 1);
+        if (!state.grid.isCollision(temp)) {
+            state.current = temp;
+            return;
+        }
+
+        state.grid.merge(state.current);
+        events.locked = true;
+        events.cleared = state.grid.clearLines();
+        int lines = __builtin_popcount(events.cleared);
+        state.score += lines * 100 * state.level;
+        state.lines += lines;
+        state.level += lines / 5;
+        state.current = newPiece();
+        if ((topRowEndsGame && state.grid.getRow(0) != 0) || state.grid.isCollision(state.current))
+            state.gameOver = true;
+    }
+
+    // Draw ghost piece for current tetromino.
+    void drawGhost(uint8_t (&tempGrid)[H][W]) const {
+        Tetromino ghost = state.current;
+        ghost.setPosition(ghost.getX(), state.grid.dropY(ghost));
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                if (ghost.isCell(i, j)) {
+                    int x = ghost.getX() + j;
+                    int y = ghost.getY() + i;
+                    if (x >= 0 && x < W && y >= 0 && y < H)
+                        tempGrid[y][x] = CELL_GHOST;
+                }
+            }
+        }
+    }
+
+public:
+    Engine(uint64_t seed, bool topRowEndsGame = false)
+        : state{Grid<W, H>(), Tetromino(TetrominoType::I, W/2 - 2), PieceQueue(), 0, 0, 1, false, false},
+          topRowEndsGame(topRowEndsGame) {
+        state.queue.reset(seed);
+        state.current = newPiece();
+    }
+
+    // Applies the inputs in order, then gravity: one frame of play.
+    Events step(const Input* inputs, int count) {
+        Events events = {false, 0, false};
+        bool wasOver = state.gameOver;
+        for (int i = 0; i < count; ++i) apply(inputs[i]);
+        gravity(events);
+        events.gameOver = state.gameOver && !wasOver;
+        return events;
+    }
+
+    Events step(Input input) { return step(&input, 1); }
+
+    // Locks piece where it rests, as if it had been steered there and
+    // left to gravity: for search that knows where the piece can go (a
+    // MoveGenerator placement) without needing the inputs.
+    Events place(const Tetromino& piece) {
+        Events events = {false, 0, false};
+        if (state.gameOver || state.paused) return events;
+        state.current = piece;
+        gravity(events);
+        events.gameOver = state.gameOver;
+        return events;
+    }
+
+    // Fill tempGrid with the board plus the ghost and current piece.
+    void compose(uint8_t (&tempGrid)[H][W]) const {
+        for (int y = 0; y < H; ++y)
+            for (int x = 0; x < W; ++x)
+                tempGrid[y][x] = state.grid.getColor(x, y);
+        drawGhost(tempGrid);
+        const Tetromino& current = state.current;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                if (current.isCell(i, j)) {
+                    int x = current.getX() + j;
+                    int y = current.getY() + i;
+                    if (x >= 0 && x < W && y >= 0 && y < H)
+                        tempGrid[y][x] = current.getColor();
+                }
+    }
+
+    const GameState<W, H>& snapshot() const { return state; }
+    void restore(const GameState<W, H>& saved) { state = saved; }
+
+    const Grid<W, H>& getGrid() const { return state.grid; }
+    const Tetromino& getCurrent() const { return state.current; }
+    TetrominoType getNext(int i) const { return state.queue.peek(i); }
+    int getScore() const { return state.score; }
+    int getLines() const { return state.lines; }
+    // Key of the whole position: board plus the falling piece.
+    uint64_t getHash() const { return state.grid.hashWith(state.current); }
+    int getLevel() const { return state.level; }
+    bool isGameOver() const { return state.gameOver; }
+    bool isPaused() const { return state.paused; }
+};
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+// Monte Carlo tree search player. Each iteration copies the position into
+// a thread's own Engine, hides what the queue deals after the preview by
+// reshuffling it, walks the tree choosing placements by UCB1, and from
+// the first new node plays a short greedy rollout whose end board is
+// scored like the bot's. The player then plays the placement of the
+// current piece that was tried most.
+//
+// Pieces past the preview are unknown, so every placement is also a
+// chance node: its children are keyed by the piece that comes up next,
+// one per type, and each rollout follows whichever piece its own shuffle
+// dealt. Inside the preview only one child is ever used.
+//
+// Iterations run on a pool of threads sharing one tree. Statistics are
+// atomics updated without locks. A thread adds a virtual loss to each
+// placement it passes, a visit with no reward yet, so threads spread out
+// instead of following each other. Nodes and placements come from fixed
+// pools claimed with fetch_add. A node is expanded by whichever thread
+// claims it first; the others roll out past it. When the pools run out
+// the tree stops growing and iterations roll out from its leaves.
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include "bot.h"
+
+#define MCTS_MAX_DEPTH 32       // placements from the root to the deepest node
+#define MCTS_REWARD_ONE 65536   // fixed point for rewards in [0, 1]
+
+struct MctsOptions {
+    int iterations = 1000; // per move
+    int threads = 1;
+    int budgetMs = 0;      // per move; 0 = no limit, else stop early when it is spent
+    int rollout = 3;       // greedy placements past the tree before scoring
+    int nodes = 4096;      // tree capacity; placements get 32 slots per node
+    double exploration = 0.35;
+    double scale = 4;      // board score difference that moves a reward from 0.5 to 0.73
+};
+
+template <int W, int H>
+class MctsBot {
+private:
+    // A position where a placement is chosen. ready: 0 new, 1 being
+    // expanded, 2 its placements are filled in.
+    struct Node {
+        atomic<int> visits;
+        atomic<int> ready;
+        int first, count;   // placements, in the edge pool
+    };
+
+    // A placement, and the chance node after it.
+    struct Edge {
+        Tetromino piece = Tetromino(TetrominoType::I, 0);
+        int placement;           // generator index, for the root's paths
+        atomic<int> visits;
+        atomic<int64_t> reward;  // sum, MCTS_REWARD_ONE each
+        atomic<int> next[7];     // node per next piece type; 0 = none yet
+    };
+
+    // A worker's own game and search state.
+    struct Searcher {
+        Engine<W, H> engine = Engine<W, H>(0);
+        MoveGenerator<W, H> generator;
+        Rng rng;
+    };
+
+    MctsOptions options;
+    vector<Node> nodes;
+    vector<Edge> edges;
+    atomic<int> nodeCount, edgeCount;
+    vector<Searcher> searchers;
+    MoveGenerator<W, H> generator;   // the root's; paths come from it
+
+    GameState<W, H> root = Engine<W, H>(0).snapshot();
+    double baseline;                 // the root board's score
+    atomic<int> started;             // iterations begun this move
+    atomic<long> rolloutCount;
+    chrono::steady_clock::time_point deadline;
+
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake, finished;
+    long generation;
+    int busy;
+    bool stopping;
+
+    double reward(const Engine<W, H>& engine) const {
+        if (engine.isGameOver()) return 0;
+        double value = scoreBoard(boardFeatures(engine.getGrid()), engine.getLines() - root.lines);
+        return 1 / (1 + exp(-(value - baseline) / options.scale));
+    }
+
+    // Fills in node's placements for the engine's current piece, best
+    // static score first so that unvisited ones are tried in that order.
+    // Placements needing more inputs than a tick holds are left out of
+    // the root. False if the edge pool is full.
+    bool expand(Node& node, const Engine<W, H>& engine, MoveGenerator<W, H>& search, bool isRoot) {
+        const Grid<W, H>& grid = engine.getGrid();
+        int count = search.generate(grid, engine.getCurrent());
+        int first = edgeCount.fetch_add(count);
+        if (first + count > (int)edges.size()) return false;
+        int kept = 0;
+        for (int i = 0; i < count; ++i) {
+            if (isRoot && search.placement(i).length > BOT_MAX_INPUTS) continue;
+            Grid<W, H> after = grid;
+            after.merge(search.piece(i));
+            int lines = __builtin_popcount(after.clearLines());
+            Edge& e = edges[first + kept++];
+            e.piece = search.piece(i);
+            e.placement = i;
+            e.visits.store(0, memory_order_relaxed);
+            // The static score rides in the reward until the first visit
+            // overwrites it; it only orders the placements below.
+            e.reward.store((int64_t)(scoreBoard(boardFeatures(after), lines) * MCTS_REWARD_ONE),
+                           memory_order_relaxed);
+            for (int t = 0; t < 7; ++t) e.next[t].store(0, memory_order_relaxed);
+        }
+        // Insertion sort by static score: a few dozen placements.
+        for (int i = 1; i < kept; ++i)
+            for (int j = i; j > 0 && edges[first + j].reward.load(memory_order_relaxed)
+                                      > edges[first + j - 1].reward.load(memory_order_relaxed); --j)
+                swapEdges(edges[first + j], edges[first + j - 1]);
+        for (int i = 0; i < kept; ++i) edges[first + i].reward.store(0, memory_order_relaxed);
+        node.first = first;
+        node.count = kept;
+        node.ready.store(2, memory_order_release);
+        return true;
+    }
+
+    static void swapEdges(Edge& a, Edge& b) {
+        swap(a.piece, b.piece);
+        swap(a.placement, b.placement);
+        int64_t r = a.reward.load(memory_order_relaxed);
+        a.reward.store(b.reward.load(memory_order_relaxed), memory_order_relaxed);
+        b.reward.store(r, memory_order_relaxed);
+    }
+
+    // UCB1 over node's placements, counting virtual losses as visits.
+    Edge& select(Node& node) {
+        int parentVisits = max(1, node.visits.load(memory_order_relaxed));
+        double logN = log((double)parentVisits);
+        Edge* best = &edges[node.first];
+        double bestValue = -1;
+        for (int i = 0; i < node.count; ++i) {
+            Edge& e = edges[node.first + i];
+            int n = e.visits.load(memory_order_relaxed);
+            if (n == 0) return e; // best unvisited by static score
+            double mean = (double)e.reward.load(memory_order_relaxed) / MCTS_REWARD_ONE / n;
+            double value = mean + options.exploration * sqrt(logN / n);
+            if (value > bestValue) { bestValue = value; best = &e; }
+        }
+        return *best;
+    }
+
+    // The node after e for the piece that came up, created if new; -1 if
+    // the node pool is full.
+    int child(Edge& e, TetrominoType next) {
+        atomic<int>& slot = e.next[(int)next];
+        int index = slot.load(memory_order_acquire);
+        if (index) return index;
+        int claimed = nodeCount.fetch_add(1);
+        if (claimed >= (int)nodes.size()) return -1;
+        Node& node = nodes[claimed];
+        node.visits.store(0, memory_order_relaxed);
+        node.ready.store(0, memory_order_relaxed);
+        if (slot.compare_exchange_strong(index, claimed, memory_order_acq_rel)) return claimed;
+        return index; // another thread got there first; the claimed node goes unused
+    }
+
+    // One iteration: select, expand, roll out, back up.
+    void iterate(Searcher& s) {
+        GameState<W, H> state = root;
+        state.queue.reshuffle(((uint64_t)s.rng.next() << 32) | s.rng.next());
+        s.engine.restore(state);
+
+        Edge* path[MCTS_MAX_DEPTH];
+        int depth = 0;
+        int index = 0;
+        while (depth < MCTS_MAX_DEPTH) {
+            Node& node = nodes[index];
+            int ready = node.ready.load(memory_order_acquire);
+            if (ready != 2) {
+                int expected = 0;
+                if (ready == 0 && node.ready.compare_exchange_strong(expected, 1))
+                    if (!expand(node, s.engine, s.generator, false)) node.ready.store(0);
+                break;
+            }
+            if (node.count == 0) break;
+            Edge& e = select(node);
+            node.visits.fetch_add(1, memory_order_relaxed);
+            e.visits.fetch_add(1, memory_order_relaxed); // virtual loss until the reward is in
+            path[depth++] = &e;
+            s.engine.place(e.piece);
+            if (s.engine.isGameOver()) break;
+            index = child(e, s.engine.getCurrent().getType());
+            if (index < 0) break;
+        }
+
+        for (int i = 0; i < options.rollout && !s.engine.isGameOver(); ++i) {
+            const Grid<W, H>& grid = s.engine.getGrid();
+            int count = s.generator.generate(grid, s.engine.getCurrent());
+            if (count == 0) break;
+            int best = 0;
+            double bestScore = -1e18;
+            for (int p = 0; p < count; ++p) {
+                Grid<W, H> after = grid;
+                after.merge(s.generator.piece(p));
+                double v = scoreBoard(boardFeatures(after), __builtin_popcount(after.clearLines()));
+                if (v > bestScore) { bestScore = v; best = p; }
+            }
+            s.engine.place(s.generator.piece(best));
+        }
+        rolloutCount.fetch_add(1, memory_order_relaxed);
+
+        int64_t r = (int64_t)(reward(s.engine) * MCTS_REWARD_ONE);
+        for (int i = 0; i < depth; ++i) path[i]->reward.fetch_add(r, memory_order_relaxed);
+    }
+
+    // Iterates until the move's iterations are used or its time is up.
+    void run(Searcher& s) {
+        while (started.fetch_add(1, memory_order_relaxed) < options.iterations) {
+            if (options.budgetMs > 0 && chrono::steady_clock::now() > deadline) return;
+            iterate(s);
+        }
+    }
+
+    void work(int w) {
+        long seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            run(searchers[w]);
+            lock_guard<mutex> guard(lock);
+            if (--busy == 0) finished.notify_one();
+        }
+    }
+
+public:
+    // seed picks the shuffles used to sample unseen pieces.
+    explicit MctsBot(const MctsOptions& opts = MctsOptions(), uint64_t seed = 1)
+        : options(opts), nodes(max(1, opts.nodes)), edges((size_t)max(1, opts.nodes) * 32),
+          nodeCount(0), edgeCount(0), searchers(max(1, opts.threads)), baseline(0),
+          started(0), rolloutCount(0), generation(0), busy(0), stopping(false) {
+        options.threads = (int)searchers.size();
+        reseed(seed);
+        for (int w = 1; w < options.threads; ++w) workers.emplace_back(&MctsBot::work, this, w);
+    }
+
+    MctsBot(const MctsBot&) = delete;
+    MctsBot& operator=(const MctsBot&) = delete;
+
+    ~MctsBot() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers) worker.join();
+    }
+
+    // Restarts the shuffles from seed, as if the bot were new, so one bot
+    // can play many games that each sample the same way as when alone.
+    void reseed(uint64_t seed) {
+        for (int w = 0; w < options.threads; ++w) searchers[w].rng = Rng{mix64(seed + w)};
+    }
+
+    // Rollouts played since the bot was made, for throughput figures.
+    long getRollouts() const { return rolloutCount.load(); }
+
+    // Like Bot::choose: the inputs for the chosen placement of the current
+    // piece, to be sent in one step(). Returns how many; 0 when the game
+    // is over or paused, or the piece has nowhere to go.
+    int choose(const Engine<W, H>& engine, Input* out) {
+        if (engine.isGameOver() || engine.isPaused()) return 0;
+        deadline = chrono::steady_clock::now() + chrono::milliseconds(options.budgetMs);
+        root = engine.snapshot();
+        baseline = scoreBoard(boardFeatures(root.grid), 0);
+        nodeCount = 1;
+        edgeCount = 0;
+        nodes[0].visits = 0;
+        nodes[0].ready = 1;
+        if (!expand(nodes[0], engine, generator, true) || nodes[0].count == 0) return 0;
+        if (nodes[0].count > 1) {
+            started = 0;
+            {
+                lock_guard<mutex> guard(lock);
+                generation++;
+                busy = (int)workers.size();
+            }
+            wake.notify_all();
+            run(searchers[0]);
+            unique_lock<mutex> guard(lock);
+            finished.wait(guard, [&] { return busy == 0; });
+        }
+
+        const Node& top = nodes[0];
+        int best = top.first;
+        for (int i = 1; i < top.count; ++i)
+            if (edges[top.first + i].visits.load() > edges[best].visits.load()) best = top.first + i;
+        return generator.path(edges[best].placement, out);
+    }
+};
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+// Reachable-placement move generator: every distinct resting place the
+// current piece can be steered to, each with a shortest input path.
+//
+// The search is breadth-first over (x, rotation, y) from the spawn
+// position, stepping by Left, Right, Rotate, SoftDrop and HardDrop as
+// Engine::apply does, so it follows soft drops into tucks and slides
+// under overhangs. A path is meant to be sent as one step() call: every
+// input lands before that tick's gravity, which then locks the piece.
+// Placements that cover the same cells (an O in any rotation, or an I, S
+// or Z turned half way) are reported once, with the shortest path found.
+//
+// States are bits: for each rotation and row, bit x+3 of a mask stands
+// for the piece at column x. fits[][] says where the piece is clear of
+// the stack, one shift per piece cell and row. Each BFS layer then moves
+// whole rows of states at once (a shift for Left and Right, a row down
+// for SoftDrop, the next rotation's row for Rotate, one sweep down each
+// rotation for HardDrop), so a search costs about one pass over the rows
+// per layer rather than a collision test per state.
+//
+// Rows well clear of the stack are not searched layer by layer. There the
+// piece only meets the walls, so anything it can do it can do in the
+// spawn row, and a state k rows further down is the spawn-row state plus
+// k soft drops. The search settles the spawn row on its own, then starts
+// the layers where the stack begins, fed by hard drops and soft drops
+// from the spawn row. On a low board this skips most of the work.
+//
+// Only the depth of each state is kept; paths are rebuilt from depths on
+// request. Everything lives in fixed arrays and generate() does no
+// allocation.
+
+#include "engine.h"
+
+template <int W, int H>
+class MoveGenerator {
+public:
+    struct Placement {
+        uint16_t state;   // (y * 4 + rotation) * (W + 3) + x + 3
+        uint8_t length;   // inputs in its path
+    };
+
+private:
+    static const int SPAN = W + 3;             // x from -3 to W-1, at bit x+3
+    static const int STATES = H * 4 * SPAN;
+    static_assert(W + 7 <= 64, "column masks hold the piece box and both walls");
+
+    uint64_t fits[4][H + 1];     // the piece fits at (x, rot, y); none at y = H
+    uint64_t reached[4][H];
+    uint64_t frontier[4][H];     // reached in the current layer
+    uint8_t depth[STATES];       // layer each searched state was found in
+    uint64_t spawnLayers[4 * SPAN][4]; // spawn-row states by depth
+    int spawnRow, firstRow;      // rows between them are clear of the stack
+    Placement placements[4 * H * W];
+    int count;
+    Tetromino turned[4];         // the piece last searched, by rotation
+
+    static int index(int x, int rot, int y) { return (y * 4 + rot) * SPAN + x + 3; }
+
+    bool isReached(int x, int rot, int y) const {
+        return x >= -3 && x < W && y >= 0 && y < H && (reached[rot][y] >> (x + 3) & 1);
+    }
+
+    // Depth of a reached state, clear rows included.
+    int depthAt(int x, int rot, int y) const {
+        if (y > spawnRow && y < firstRow) return depth[index(x, rot, spawnRow)] + y - spawnRow;
+        return depth[index(x, rot, y)];
+    }
+
+    // Fills fits[][] for each rotation. A cell at column x+j of row y+i is
+    // bit x+j+4 of the walled row, so shifting that row right by j+1 lines
+    // it up with bit x+3.
+    void computeFits(const Grid<W, H>& grid) {
+        const uint64_t walls = ~((((uint64_t)1 << W) - 1) << 4);
+        uint64_t walled[H + 4];
+        for (int y = 0; y < H; ++y) walled[y] = (uint64_t)grid.getRow(y) << 4 | walls;
+        for (int y = H; y < H + 4; ++y) walled[y] = ~(uint64_t)0;
+        for (int rot = 0; rot < 4; ++rot) {
+            const Tetromino& t = turned[rot];
+            for (int y = 0; y < H; ++y) {
+                uint64_t blocked = 0;
+                for (int row = 0; row < 4; ++row)
+                    for (unsigned bits = t.getRowBits(row); bits; bits &= bits - 1)
+                        blocked |= walled[y + row] >> (__builtin_ctz(bits) + 1);
+                fits[rot][y] = ~blocked & (((uint64_t)1 << SPAN) - 1);
+            }
+            fits[rot][H] = 0;
+        }
+    }
+
+    // Left, Right and Rotate within the spawn row, layer by layer, from
+    // the spawn state. Returns how many layers there are.
+    int searchSpawnRow(int x0, int rot0) {
+        int y = spawnRow, layers = 1;
+        memset(spawnLayers[0], 0, sizeof(spawnLayers[0]));
+        reached[rot0][y] = spawnLayers[0][rot0] = (uint64_t)1 << (x0 + 3);
+        depth[index(x0, rot0, y)] = 0;
+        for (bool grew = true; grew; ) {
+            const uint64_t* f = spawnLayers[layers - 1];
+            uint64_t* next = spawnLayers[layers];
+            grew = false;
+            for (int rot = 0; rot < 4; ++rot) {
+                uint64_t fresh = (f[rot] >> 1 | f[rot] << 1 | f[(rot + 3) & 3]) & fits[rot][y] & ~reached[rot][y];
+                next[rot] = fresh;
+                reached[rot][y] |= fresh;
+                grew |= fresh != 0;
+                for (; fresh; fresh &= fresh - 1)
+                    depth[index(__builtin_ctzll(fresh) - 3, rot, y)] = (uint8_t)layers;
+            }
+            if (grew) layers++;
+        }
+        return layers;
+    }
+
+    // Expands the frontier, all in rows from firstRow down, by one input,
+    // and adds what the spawn-row states spawnLayers[d-1] reach by a hard
+    // drop and what they reach by soft-dropping into firstRow. Returns
+    // whether anything new was reached, recording its depth.
+    bool layer(int d, int spawnLayerCount) {
+        uint64_t next[4][H];
+        memset(next, 0, sizeof(next));
+        for (int rot = 0; rot < 4; ++rot) {
+            int turn = (rot + 1) & 3;
+            uint64_t carry = 0; // falling from a hard drop
+            for (int y = firstRow; y < H; ++y) {
+                uint64_t f = frontier[rot][y];
+                carry |= f;
+                if (carry) {
+                    next[rot][y] |= carry & ~fits[rot][y + 1];
+                    carry &= fits[rot][y + 1];
+                }
+                if (!f) continue;
+                next[rot][y] |= (f >> 1 | f << 1) & fits[rot][y];
+                next[turn][y] |= f & fits[turn][y];
+                if (y + 1 < H) next[rot][y + 1] |= f & fits[rot][y + 1];
+            }
+        }
+        int dropped = d - 1, entering = d - (firstRow - spawnRow);
+        for (int rot = 0; rot < 4; ++rot) {
+            if (dropped < spawnLayerCount) {
+                uint64_t carry = spawnLayers[dropped][rot];
+                for (int y = spawnRow; carry && y < H; ++y) {
+                    next[rot][y] |= carry & ~fits[rot][y + 1];
+                    carry &= fits[rot][y + 1];
+                }
+            }
+            if (entering >= 0 && entering < spawnLayerCount && firstRow < H)
+                next[rot][firstRow] |= spawnLayers[entering][rot] & fits[rot][firstRow];
+        }
+
+        bool grew = false;
+        for (int rot = 0; rot < 4; ++rot)
+            for (int y = firstRow; y < H; ++y) {
+                uint64_t fresh = next[rot][y] & ~reached[rot][y];
+                frontier[rot][y] = fresh;
+                reached[rot][y] |= fresh;
+                grew |= fresh != 0;
+                for (; fresh; fresh &= fresh - 1)
+                    depth[index(__builtin_ctzll(fresh) - 3, rot, y)] = (uint8_t)d;
+            }
+        return grew;
+    }
+
+public:
+    MoveGenerator() : count(0), turned{Tetromino(TetrominoType::I, 0), Tetromino(TetrominoType::I, 0),
+                                       Tetromino(TetrominoType::I, 0), Tetromino(TetrominoType::I, 0)} {}
+
+    // Finds every placement of spawn on grid. Returns how many there are;
+    // none if spawn itself does not fit.
+    int generate(const Grid<W, H>& grid, const Tetromino& spawn) {
+        count = 0;
+        Tetromino t = spawn;
+        for (int r = 0; r < 4; ++r, t.rotate()) turned[t.getRotation()] = t;
+        computeFits(grid);
+
+        int x0 = spawn.getX(), rot0 = spawn.getRotation(), y0 = spawn.getY();
+        if (x0 < -3 || x0 >= W || y0 < 0 || y0 >= H || !(fits[rot0][y0] >> (x0 + 3) & 1)) return 0;
+        memset(reached, 0, sizeof(reached));
+        memset(frontier, 0, sizeof(frontier));
+
+        // Rows from the spawn row to firstRow - 1 are clear: the piece's
+        // box and the row under it are above every column.
+        int top = H;
+        for (int x = 0; x < W; ++x) top = min(top, H - grid.getHeight(x));
+        spawnRow = y0;
+        firstRow = max(y0 + 1, top - 4);
+        int spawnLayerCount = searchSpawnRow(x0, rot0);
+        for (int y = spawnRow + 1; y < firstRow; ++y)
+            for (int rot = 0; rot < 4; ++rot) reached[rot][y] = reached[rot][spawnRow];
+        for (int d = 1; layer(d, spawnLayerCount) || d < spawnLayerCount + firstRow - spawnRow; ++d) {}
+
+        // Rotations covering the same cells share a canonical one (the
+        // first such); shift takes a rotation's box corner to its cells'
+        // top-left corner.
+        int canon[4], shiftX[4], shiftY[4];
+        uint16_t cells[4];
+        for (int r = 0; r < 4; ++r) {
+            uint16_t shape = turned[r].getShape();
+            shiftY[r] = 0;
+            while (!(shape & 0xF)) { shape >>= 4; shiftY[r]++; }
+            shiftX[r] = 0;
+            while (!(shape & 0x1111)) { shape >>= 1; shiftX[r]++; }
+            cells[r] = shape;
+            canon[r] = r;
+            for (int q = 0; q < r; ++q)
+                if (cells[q] == shape) { canon[r] = canon[q]; break; }
+        }
+
+        // Resting states: the next gravity would lock them. Of states
+        // covering the same cells, keep the shallowest (then the lowest
+        // rotation).
+        for (int y = 0; y < H; ++y)
+            for (int rot = 0; rot < 4; ++rot)
+                for (uint64_t rest = reached[rot][y] & ~fits[rot][y + 1]; rest; rest &= rest - 1) {
+                    int x = __builtin_ctzll(rest) - 3, s = index(x, rot, y);
+                    bool shadowed = false;
+                    for (int q = 0; q < 4 && !shadowed; ++q) {
+                        if (q == rot || canon[q] != canon[rot]) continue;
+                        int qx = x + shiftX[rot] - shiftX[q], qy = y + shiftY[rot] - shiftY[q];
+                        if (!isReached(qx, q, qy) || (fits[q][qy + 1] >> (qx + 3) & 1)) continue;
+                        int qd = depthAt(qx, q, qy);
+                        shadowed = qd < depth[s] || (qd == depth[s] && q < rot);
+                    }
+                    if (!shadowed) placements[count++] = Placement{(uint16_t)s, depth[s]};
+                }
+        return count;
+    }
+
+    int getCount() const { return count; }
+    const Placement& placement(int i) const { return placements[i]; }
+
+    // Where placement i rests; merge() it to place it.
+    Tetromino piece(int i) const {
+        int s = placements[i].state;
+        Tetromino t = turned[s / SPAN % 4];
+        t.setPosition(s % SPAN - 3, s / SPAN / 4);
+        return t;
+    }
+
+    // Writes placement i's inputs, from the spawn, into out (room for
+    // placement(i).length) and returns how many. Walks back from the
+    // placement, each time to a state one layer shallower that the input
+    // leads from.
+    int path(int i, Input* out) const {
+        int s = placements[i].state;
+        int x = s % SPAN - 3, rot = s / SPAN % 4, y = s / SPAN / 4;
+        int length = placements[i].length;
+        for (int d = length - 1; d >= 0; --d) {
+            auto from = [&](int px, int prot, int py) {
+                return isReached(px, prot, py) && depthAt(px, prot, py) == d;
+            };
+            Input input = Input::None;
+            if (from(x + 1, rot, y)) { input = Input::Left; x++; }
+            else if (from(x - 1, rot, y)) { input = Input::Right; x--; }
+            else if (from(x, (rot + 3) & 3, y)) { input = Input::Rotate; rot = (rot + 3) & 3; }
+            else if (from(x, rot, y - 1)) { input = Input::SoftDrop; y--; }
+            else if (!(fits[rot][y + 1] >> (x + 3) & 1)) {
+                // A hard drop from higher up the same clear column.
+                for (int py = y - 1; py >= 0 && (fits[rot][py] >> (x + 3) & 1); --py)
+                    if (from(x, rot, py)) { input = Input::HardDrop; y = py; break; }
+            }
+            out[d] = input;
+        }
+        return length;
+    }
+};
+
+#endif
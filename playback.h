@@ -0,0 +1,86 @@
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+// Playback controls for the terminal replay viewers in tetris.cpp and
+// tetrisX2.cpp: speed, pause and frame-step over a ReplayCursor, paced by
+// the wall clock. The viewers redraw at most once per REPLAY_FRAME_USEC,
+// however many ticks were played in between, so high speeds cost no more
+// terminal output than 1x.
+
+#include <string>
+#include "replay.h"
+
+const double REPLAY_SPEEDS[] = {0.25, 0.5, 1, 2, 4, 8, 16, 32, 64};
+const int REPLAY_SPEED_COUNT = sizeof(REPLAY_SPEEDS) / sizeof(REPLAY_SPEEDS[0]);
+#define REPLAY_FRAME_USEC 40000 // redraw at most 25 times a second
+
+template <int W, int H>
+class ReplayPlayback {
+private:
+    ReplayCursor<W, H>& cursor;
+    int speed;     // index into REPLAY_SPEEDS
+    bool paused;
+    double owed;   // fraction of a tick carried to the next advance()
+
+public:
+    // The cursor must be indexed, for stepping back. speed is rounded up
+    // to the nearest one offered.
+    ReplayPlayback(ReplayCursor<W, H>& cursor, double startSpeed)
+        : cursor(cursor), speed(0), paused(false), owed(0) {
+        while (speed + 1 < REPLAY_SPEED_COUNT && REPLAY_SPEEDS[speed] < startSpeed) speed++;
+    }
+
+    // Applies one key. Returns false when the viewer should quit.
+    bool key(char ch) {
+        switch (tolower(ch)) {
+            case ' ': case 'p':
+                // Resuming at the end starts over.
+                if (paused && cursor.getTick() == cursor.getTicks()) cursor.seek(0);
+                paused = !paused;
+                break;
+            case '+': case '=': speed = min(speed + 1, REPLAY_SPEED_COUNT - 1); break;
+            case '-': case '_': speed = max(speed - 1, 0); break;
+            case '.':
+                paused = true;
+                cursor.step();
+                break;
+            case ',':
+                paused = true;
+                cursor.seek(cursor.getTick() - 1);
+                break;
+            case 27: case 'q': return false;
+        }
+        owed = 0;
+        return true;
+    }
+
+    // Plays the ticks due after seconds of wall time, when each tick of
+    // the recorded game lasted tickSeconds. Pauses at the end. Returns
+    // whether any tick was played.
+    bool advance(double seconds, double tickSeconds) {
+        if (paused) return false;
+        owed += seconds * REPLAY_SPEEDS[speed] / tickSeconds;
+        bool moved = false;
+        for (; owed >= 1; owed -= 1) {
+            if (!cursor.step()) {
+                paused = true;
+                owed = 0;
+                break;
+            }
+            moved = true;
+        }
+        return moved;
+    }
+
+    // Position, speed and keys, for under the board.
+    string status() const {
+        char speedText[16];
+        snprintf(speedText, sizeof(speedText), "%gx", REPLAY_SPEEDS[speed]);
+        string line = "Replay  tick " + to_string(cursor.getTick()) + "/" + to_string(cursor.getTicks())
+                      + "  speed " + speedText;
+        if (paused) line += cursor.getTick() == cursor.getTicks() ? "  END" : "  PAUSED";
+        return line + "\nSpace - Play/Pause  +/- - Speed  . - Step  , - Step back  Q/ESC - Quit\n";
+    }
+};
+
+#endif
@@ -0,0 +1,485 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// Compact binary replays. A game is fully determined by its seed and the
+// inputs applied on each tick, so that is all a replay stores:
+//
+//   "TRPL" version players width height flags varint(seed)
+//   varint(keyframe interval)
+//   (token | keyframe-token state*)* end-token result*
+//
+// Each input is one varint token (delta << 4 | player << 3 | input), where
+// delta is the number of ticks since the previous token. Idle ticks cost
+// nothing and an input within 7 ticks of the last one is a single byte.
+// The end token is Input::None for player 0, its delta running to the
+// tick the recording stopped on. It is followed by one result per player
+// (varint score, varint lines, 8-byte little-endian state hash) that a
+// verifier can check by replaying.
+//
+// Every keyframe-interval ticks a keyframe token (Input::None for player
+// 1) is followed by each player's full GameState, so a viewer can seek by
+// restoring the nearest keyframe and simulating at most that many ticks.
+// A keyframe at tick t is the state before tick t is played.
+//
+// Version 1 replays have no results, version 2 no keyframes.
+
+#include <cstdio>
+#include <climits>
+#include <vector>
+#include "engine.h"
+
+#define REPLAY_VERSION 3
+#define REPLAY_SAME_PIECES 1 // flags: versus players were dealt one sequence
+// Ticks between keyframes the games record: about 100 seconds of play at
+// the starting speed, and under 0.25 bytes per tick of keyframe data.
+#define REPLAY_KEYFRAME_INTERVAL 500
+
+const char REPLAY_MAGIC[4] = {'T', 'R', 'P', 'L'};
+
+struct ReplayHeader {
+    uint8_t players; // 1 for tetris, 2 for tetrisX2
+    uint8_t width, height;
+    uint8_t flags;
+    uint64_t seed;   // Game seed, or the match seed for versus
+    uint32_t keyframeInterval; // 0 = no keyframes
+};
+
+// How a player's game stood when the recording stopped.
+struct ReplayResult {
+    int score;
+    int lines;
+    uint64_t hash; // Engine::getHash
+};
+
+template <int W, int H>
+ReplayResult resultOf(const Engine<W, H>& engine) {
+    return ReplayResult{engine.getScore(), engine.getLines(), engine.getHash()};
+}
+
+// Appends to a FILE or to a byte vector through a fixed buffer, so a
+// recorded frame costs a few byte stores and never allocates. end()
+// flushes; the caller owns and closes the FILE.
+class ReplayWriter {
+private:
+    FILE* file;
+    vector<uint8_t>* memory;
+    uint8_t buf[4096];
+    int used;
+    long lastTick;
+    uint32_t keyframeInterval;
+
+    void put(uint8_t b) {
+        if (used == (int)sizeof(buf)) flush();
+        buf[used++] = b;
+    }
+
+    void varint(uint64_t v) {
+        while (v >= 0x80) { put((uint8_t)(v | 0x80)); v >>= 7; }
+        put((uint8_t)v);
+    }
+
+    void token(long tick, int player, Input input) {
+        varint((uint64_t)(tick - lastTick) << 4 | player << 3 | (int)input);
+        lastTick = tick;
+    }
+
+    void zigzag(int v) { varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31)); }
+
+    // Portable form of a GameState: each row's occupancy mask followed by
+    // its cells' palette indices two to a byte, then the piece, queue,
+    // counters and flags. Heights and the hash are rebuilt on load.
+    template <int W, int H>
+    void state(const GameState<W, H>& s) {
+        for (int y = 0; y < H; ++y) {
+            uint64_t mask = s.grid.getRow(y);
+            varint(mask);
+            int half = -1;
+            for (int x = 0; x < W; ++x) {
+                if (!(mask >> x & 1)) continue;
+                if (half < 0) half = s.grid.getColor(x, y);
+                else { put((uint8_t)(half | s.grid.getColor(x, y) << 4)); half = -1; }
+            }
+            if (half >= 0) put((uint8_t)half);
+        }
+        put((uint8_t)((int)s.current.getType() << 2 | s.current.getRotation()));
+        zigzag(s.current.getX());
+        zigzag(s.current.getY());
+        for (int i = 0; i < 8; ++i) put((uint8_t)(s.queue.rng.state >> (8 * i)));
+        for (int i = 0; i < 7; ++i) put(s.queue.bag[i]);
+        put(s.queue.bagLeft);
+        for (int i = 0; i < PREVIEW; ++i) put(s.queue.ring[i]);
+        put(s.queue.head);
+        varint((uint32_t)s.score);
+        varint((uint32_t)s.lines);
+        varint((uint32_t)s.level);
+        put((uint8_t)(s.gameOver | s.paused << 1));
+    }
+
+public:
+    ReplayWriter(FILE* out) : file(out), memory(nullptr), used(0), lastTick(0), keyframeInterval(0) {}
+    ReplayWriter(vector<uint8_t>* out)
+        : file(nullptr), memory(out), used(0), lastTick(0), keyframeInterval(0) {}
+
+    void begin(const ReplayHeader& header) {
+        for (char c : REPLAY_MAGIC) put(c);
+        put(REPLAY_VERSION);
+        put(header.players);
+        put(header.width);
+        put(header.height);
+        put(header.flags);
+        varint(header.seed);
+        varint(header.keyframeInterval);
+        lastTick = 0;
+        keyframeInterval = header.keyframeInterval;
+    }
+
+    // Whether a keyframe is due before tick is played.
+    bool wantsKeyframe(long tick) const {
+        return keyframeInterval && tick > 0 && tick % keyframeInterval == 0;
+    }
+
+    // Every player's state before tick is played; call before that tick's
+    // inputs.
+    template <int W, int H>
+    void keyframe(long tick, const GameState<W, H>* states, int players) {
+        token(tick, 1, Input::None);
+        for (int p = 0; p < players; ++p) state(states[p]);
+    }
+
+    // Input applied on tick (0-based) by player 0 or 1. Ticks must not
+    // go backwards.
+    void input(long tick, int player, Input in) {
+        if (in != Input::None) token(tick, player, in);
+    }
+
+    // Closes the replay: ticks is the number of ticks that were played,
+    // results one entry per player.
+    void end(long ticks, const ReplayResult* results, int players) {
+        token(ticks, 0, Input::None);
+        for (int p = 0; p < players; ++p) {
+            varint((uint32_t)results[p].score);
+            varint((uint32_t)results[p].lines);
+            for (int i = 0; i < 8; ++i) put((uint8_t)(results[p].hash >> (8 * i)));
+        }
+        flush();
+    }
+
+    void flush() {
+        if (file) fwrite(buf, 1, used, file);
+        else if (memory) memory->insert(memory->end(), buf, buf + used);
+        used = 0;
+    }
+};
+
+// Reads a replay from memory. Every call reports malformed or truncated
+// data by returning false.
+class ReplayReader {
+private:
+    const uint8_t* p;
+    const uint8_t* limit;
+    long tick;
+    uint8_t version; // of the replay whose header was read last
+
+    bool varint(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == limit) return false;
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool bytes(uint8_t* out, int n) {
+        if (limit - p < n) return false;
+        memcpy(out, p, n);
+        p += n;
+        return true;
+    }
+
+    bool zigzag(int& v) {
+        uint64_t u;
+        if (!varint(u)) return false;
+        v = (int)(u >> 1) ^ -(int)(u & 1);
+        return true;
+    }
+
+public:
+    ReplayReader(const uint8_t* data, size_t size) : p(data), limit(data + size), tick(0), version(0) {}
+
+    bool header(ReplayHeader& header) {
+        if (limit - p < 9 || memcmp(p, REPLAY_MAGIC, 4) != 0) return false;
+        version = p[4];
+        if (version < 1 || version > REPLAY_VERSION) return false;
+        header.players = p[5];
+        header.width = p[6];
+        header.height = p[7];
+        header.flags = p[8];
+        p += 9;
+        tick = 0;
+        uint64_t interval = 0;
+        if (!varint(header.seed) || (version >= 3 && !varint(interval))) return false;
+        header.keyframeInterval = (uint32_t)interval;
+        return header.players == 1 || header.players == 2;
+    }
+
+    // Format version of the replay whose header was read last.
+    int getVersion() const { return version; }
+
+    // Next input and the tick it applies on. Input::None marks the end of
+    // the replay for player 0 (atTick = number of ticks played) and a
+    // keyframe for player 1, whose states follow.
+    bool next(long& atTick, int& player, Input& input) {
+        uint64_t v;
+        if (!varint(v)) return false;
+        tick += (long)(v >> 4);
+        atTick = tick;
+        player = (v >> 3) & 1;
+        input = (Input)(v & 7);
+        return true;
+    }
+
+    // The result recorded for one player, read after the end token.
+    bool result(ReplayResult& result) {
+        uint64_t score, lines;
+        if (!varint(score) || !varint(lines) || limit - p < 8) return false;
+        result.score = (int)score;
+        result.lines = (int)lines;
+        result.hash = 0;
+        for (int i = 0; i < 8; ++i) result.hash |= (uint64_t)*p++ << (8 * i);
+        return true;
+    }
+
+    // One player's keyframe state, in the form ReplayWriter::state wrote.
+    template <int W, int H>
+    bool state(GameState<W, H>& s) {
+        uint8_t cells[H][W];
+        for (int y = 0; y < H; ++y) {
+            uint64_t mask;
+            if (!varint(mask) || mask >> W) return false;
+            int half = -1;
+            for (int x = 0; x < W; ++x) {
+                cells[y][x] = CELL_EMPTY;
+                if (!(mask >> x & 1)) continue;
+                if (half < 0) {
+                    if (p == limit) return false;
+                    half = *p++;
+                    cells[y][x] = half & 0xF;
+                    half >>= 4;
+                } else {
+                    cells[y][x] = half;
+                    half = -1;
+                }
+                if (cells[y][x] < 1 || cells[y][x] > 7) return false;
+            }
+        }
+        s.grid.load(cells);
+
+        uint8_t piece, queue[7 + 1 + PREVIEW + 1], flags;
+        int x, y;
+        uint64_t rng = 0, score, lines, level;
+        if (!bytes(&piece, 1) || (piece >> 2) > 6 || !zigzag(x) || !zigzag(y)) return false;
+        if (limit - p < 8) return false;
+        for (int i = 0; i < 8; ++i) rng |= (uint64_t)*p++ << (8 * i);
+        if (!bytes(queue, sizeof(queue))) return false;
+        if (!varint(score) || !varint(lines) || !varint(level) || !bytes(&flags, 1)) return false;
+
+        Tetromino current((TetrominoType)(piece >> 2), x);
+        for (int r = piece & 3; r > 0; --r) current.rotate();
+        current.setPosition(x, y);
+        // The viewer restores keyframes without replaying up to them, so a
+        // piece off the board or a zero level would reach merge and the
+        // tick interval unchecked. A finished game's last piece may overlap
+        // the stack but must still lie within the walls.
+        if (x < -3 || x >= W || y < 0 || y >= H || level < 1 || level > INT_MAX) return false;
+        if (flags & 1 ? Grid<W, H>().isCollision(current) : s.grid.isCollision(current)) return false;
+        s.current = current;
+        s.queue.rng = Rng{rng};
+        memcpy(s.queue.bag, queue, 7);
+        s.queue.bagLeft = queue[7];
+        memcpy(s.queue.ring, queue + 8, PREVIEW);
+        s.queue.head = queue[8 + PREVIEW];
+        for (int i = 0; i < 7; ++i) if (s.queue.bag[i] > 6) return false;
+        for (int i = 0; i < PREVIEW; ++i) if (s.queue.ring[i] > 6) return false;
+        if (s.queue.bagLeft > 7 || s.queue.head >= PREVIEW) return false;
+        s.score = (int)score;
+        s.lines = (int)lines;
+        s.level = (int)level;
+        s.gameOver = flags & 1;
+        s.paused = flags >> 1 & 1;
+        return true;
+    }
+
+    // Bytes consumed so far.
+    const uint8_t* position() const { return p; }
+    long getTick() const { return tick; }
+};
+
+// The Engine a replay's player (0 or 1) was played on, as tetris or
+// tetrisX2 built it.
+template <int W, int H>
+Engine<W, H> replayEngine(const ReplayHeader& header, int player) {
+    if (header.players == 1) return Engine<W, H>(header.seed);
+    return Engine<W, H>(versusSeed(header.seed, player + 1, header.flags & REPLAY_SAME_PIECES), true);
+}
+
+// Plays a replay forward tick by tick on the engines it was recorded on,
+// and seeks within it. A cursor starts at tick 0 with the reader just past
+// the header. index() scans the rest of the replay once to find its
+// keyframes and length; after that seek() restores the nearest keyframe at
+// or before the target and simulates at most one keyframe interval.
+// Keyframes met while playing forward are checked against the simulated
+// state, so a replay whose keyframes disagree with its inputs is rejected.
+template <int W, int H>
+class ReplayCursor {
+private:
+    struct Keyframe {
+        long tick;
+        ReplayReader reader; // positioned at the keyframe's states
+    };
+
+    ReplayHeader header;
+    ReplayReader start, reader;
+    Engine<W, H> engines[2];
+    long tick;
+    long ticks;              // length of the replay, once known; -1 before
+    vector<Keyframe> keyframes;
+    // The next token, read ahead.
+    long nextAt;
+    int nextPlayer;
+    Input nextInput;
+    bool valid;
+
+    bool readToken() {
+        valid = valid && reader.next(nextAt, nextPlayer, nextInput) && nextAt >= tick
+                && (nextPlayer < header.players || nextInput == Input::None);
+        return valid;
+    }
+
+    bool atEnd() const { return nextInput == Input::None && nextPlayer == 0 && nextAt == tick; }
+
+    static bool sameState(const GameState<W, H>& a, const GameState<W, H>& b) {
+        return a.grid.hashWith(a.current) == b.grid.hashWith(b.current)
+            && a.queue.rng.state == b.queue.rng.state && a.queue.head == b.queue.head
+            && a.queue.bagLeft == b.queue.bagLeft
+            && memcmp(a.queue.bag, b.queue.bag, sizeof(a.queue.bag)) == 0
+            && memcmp(a.queue.ring, b.queue.ring, sizeof(a.queue.ring)) == 0
+            && a.score == b.score && a.lines == b.lines && a.level == b.level
+            && a.gameOver == b.gameOver && a.paused == b.paused;
+    }
+
+    // Reads the keyframe states at the reader into saved.
+    bool readKeyframe(GameState<W, H> (&saved)[2]) {
+        for (int p = 0; p < header.players; ++p)
+            if (!reader.state(saved[p])) return false;
+        return true;
+    }
+
+public:
+    ReplayCursor(const ReplayReader& afterHeader, const ReplayHeader& header)
+        : header(header), start(afterHeader), reader(afterHeader),
+          engines{replayEngine<W, H>(header, 0), replayEngine<W, H>(header, 1)},
+          tick(0), ticks(-1), valid(true) {
+        readToken();
+    }
+
+    // Plays one tick: the inputs recorded for it, in order. False at the
+    // end of the replay or on malformed data.
+    bool step() {
+        const int MAX_KEYS = 32;
+        Input keys[2][MAX_KEYS];
+        int count[2] = {0, 0};
+        while (valid && nextAt == tick && !atEnd()) {
+            if (nextInput == Input::None) {
+                GameState<W, H> saved[2] = {engines[0].snapshot(), engines[1].snapshot()};
+                if (!readKeyframe(saved)) return valid = false;
+                for (int p = 0; p < header.players; ++p)
+                    if (!sameState(saved[p], engines[p].snapshot())) return valid = false;
+            } else {
+                if (count[nextPlayer] == MAX_KEYS) return valid = false;
+                keys[nextPlayer][count[nextPlayer]++] = nextInput;
+            }
+            readToken();
+        }
+        if (!valid || atEnd()) return false;
+        for (int p = 0; p < header.players; ++p) engines[p].step(keys[p], count[p]);
+        tick++;
+        return true;
+    }
+
+    // Plays to the end of the replay. False if it is malformed; the reader
+    // is then left just past the end token, at the results.
+    bool finish() {
+        while (step()) {}
+        return valid;
+    }
+
+    // Scans from the current position to the end to find the keyframes
+    // and the replay's length, leaving the cursor where it was.
+    bool index() {
+        ReplayReader scan = reader;
+        long at = nextAt;
+        int player = nextPlayer;
+        Input input = nextInput;
+        keyframes.clear();
+        GameState<W, H> scratch = engines[0].snapshot();
+        for (bool ok = valid; ; ok = scan.next(at, player, input)) {
+            if (!ok) return false;
+            if (input != Input::None) continue;
+            if (player == 0) break;
+            keyframes.push_back(Keyframe{at, scan});
+            for (int p = 0; p < header.players; ++p)
+                if (!scan.state(scratch)) return false;
+        }
+        ticks = at;
+        return true;
+    }
+
+    // Moves to the state before target is played, from the nearest
+    // keyframe at or before target (or the start). Needs index().
+    bool seek(long target) {
+        target = max(0L, min(target, ticks));
+        size_t k = upper_bound(keyframes.begin(), keyframes.end(), target,
+                               [](long t, const Keyframe& f) { return t < f.tick; }) - keyframes.begin();
+        if (k == 0 && target < tick) {
+            reader = start;
+            tick = 0;
+            valid = true;
+            for (int p = 0; p < 2; ++p) engines[p] = replayEngine<W, H>(header, p);
+            readToken();
+        } else if (k > 0 && (keyframes[k - 1].tick > tick || target < tick)) {
+            reader = keyframes[k - 1].reader;
+            tick = keyframes[k - 1].tick;
+            GameState<W, H> saved[2] = {engines[0].snapshot(), engines[1].snapshot()};
+            if (!readKeyframe(saved)) return valid = false;
+            for (int p = 0; p < header.players; ++p) engines[p].restore(saved[p]);
+            valid = true;
+            readToken();
+        }
+        while (tick < target)
+            if (!step()) return false;
+        return true;
+    }
+
+    const Engine<W, H>& getEngine(int player) const { return engines[player]; }
+    const ReplayHeader& getHeader() const { return header; }
+    long getTick() const { return tick; }
+    long getTicks() const { return ticks; }
+    // The reader, for the results once finish() has returned true.
+    ReplayReader& getReader() { return reader; }
+};
+
+// Reads a whole file into data; false if it cannot be read.
+inline bool readReplayFile(const char* path, vector<uint8_t>& data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t chunk[65536];
+    size_t n;
+    data.clear();
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return true;
+}
+
+#endif
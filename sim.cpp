@@ -0,0 +1,248 @@
+// Batch simulator: plays many headless games across all cores with a
+// built-in policy and reports throughput and outcome statistics.
+//
+//   g++ -O2 -pthread sim.cpp -o tetris-sim
+//   ./tetris-sim [--games N] [--seed S] [--policy greedy|bot|mcts|random]
+//                [--pieces CAP] [--threads T] [--width 4|10|40]
+//                [--record DIR] [--archive FILE] [--lookahead D] [--beam N]
+//                [--rollouts N] [--search-threads T]
+//
+// Game i is played with seed S+i, so any run (or any single game from it)
+// can be reproduced exactly. --record writes each game's replay to
+// DIR/game-<seed>.trpl; --archive appends them all to one archive instead,
+// committed once the run is done. --lookahead and --beam set how many
+// pieces the bot policy searches and how many boards it keeps per piece;
+// each game's search runs on the thread playing it. The mcts policy plays
+// --rollouts iterations a move on --search-threads threads of its own
+// (default 1) on top of the --threads playing games.
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+using namespace std;
+
+#include "replay.h"
+#include "bot.h"
+#include "mcts.h"
+#include "archive.h"
+
+struct SimOptions {
+    long games = 1000;
+    uint64_t seed = 1;
+    string policy = "greedy";
+    long pieceCap = 1000;
+    int threads = 0; // 0 = one per core
+    int width = DEFAULT_WIDTH;
+    string recordDir; // empty = no replays
+    string archivePath; // empty = no archive
+    BotOptions bot;     // depth and width for the bot policy
+    MctsOptions mcts;   // iterations and threads for the mcts policy
+};
+
+// The archive every worker appends its finished games to.
+struct SimArchive {
+    mutex lock;
+    ArchiveWriter writer;
+    bool failed = false;
+};
+
+// Totals gathered by one worker; merged once all games are done.
+struct SimTotals {
+    long games = 0;
+    long pieces = 0;
+    long ticks = 0;
+    long clears[5] = {0, 0, 0, 0, 0}; // locks clearing 0..4 rows
+};
+
+// Plays game `seed` to game over or the piece cap, adding to totals.
+// bot and mcts are the worker's, made once for all its games; each is
+// null unless the policy uses it. Returns the final score.
+template <int W, int H>
+static int playGame(uint64_t seed, const SimOptions& options, SimTotals& totals, SimArchive* archive,
+                    Bot<W, H>* bot, MctsBot<W, H>* mcts) {
+    const Input randomKeys[] = {Input::None, Input::Left, Input::Right, Input::Rotate,
+                                Input::SoftDrop, Input::HardDrop};
+    bool greedy = options.policy == "greedy", heuristic = options.policy == "bot";
+    bool planning = options.policy == "mcts";
+    Engine<W, H> engine(seed);
+    Rng keys{mix64(seed ^ 0x4B455953ull)};
+    if (planning) mcts->reseed(seed);
+    Input inputs[max(4 + W + 1, BOT_MAX_INPUTS)];
+    int count = 1;
+    long pieces = 0, ticks = 0;
+
+    FILE* out = nullptr;
+    if (!options.recordDir.empty()) {
+        string path = options.recordDir + "/game-" + to_string(seed) + ".trpl";
+        if (!(out = fopen(path.c_str(), "wb"))) cout << "Cannot write replay " << path << "\n";
+    }
+    vector<uint8_t> memory;
+    ReplayWriter writer = archive ? ReplayWriter(&memory) : ReplayWriter(out);
+    bool recording = out || archive;
+    if (recording) writer.begin(ReplayHeader{1, W, H, 0, seed, REPLAY_KEYFRAME_INTERVAL});
+
+    while (!engine.isGameOver() && pieces < options.pieceCap) {
+        if (greedy)         count = greedyInputs(engine, inputs);
+        else if (heuristic) count = bot->choose(engine, inputs);
+        else if (planning)  count = mcts->choose(engine, inputs);
+        else                inputs[0] = randomKeys[keys.below(6)];
+        if (recording) {
+            if (writer.wantsKeyframe(ticks)) writer.keyframe(ticks, &engine.snapshot(), 1);
+            for (int i = 0; i < count; ++i) writer.input(ticks, 0, inputs[i]);
+        }
+        Events events = engine.step(inputs, count);
+        ticks++;
+        totals.ticks++;
+        if (events.locked) {
+            pieces++;
+            totals.clears[__builtin_popcount(events.cleared)]++;
+        }
+    }
+    ReplayResult result = resultOf(engine);
+    if (recording) writer.end(ticks, &result, 1);
+    if (out) fclose(out);
+    if (archive) {
+        lock_guard<mutex> guard(archive->lock);
+        if (archive->writer.add(memory.data(), memory.size(), options.policy.c_str(),
+                                result.score, result.lines, ticks) < 0)
+            archive->failed = true;
+    }
+    totals.games++;
+    totals.pieces += pieces;
+    return engine.getScore();
+}
+
+// Work-stealing pool: each worker starts with a contiguous block of game
+// indices and takes from the back of its own deque. When it runs dry it
+// steals from the front of another worker's, so a worker stuck behind a
+// few long games does not hold up the batch while the others sit idle.
+struct WorkQueue {
+    mutex lock;
+    deque<long> games;
+};
+
+static bool takeWork(vector<WorkQueue>& queues, int self, long& game) {
+    {
+        lock_guard<mutex> guard(queues[self].lock);
+        if (!queues[self].games.empty()) {
+            game = queues[self].games.back();
+            queues[self].games.pop_back();
+            return true;
+        }
+    }
+    for (size_t n = 1; n < queues.size(); ++n) {
+        WorkQueue& victim = queues[(self + n) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.games.empty()) {
+            game = victim.games.front();
+            victim.games.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+static int percentile(const vector<int>& sorted, double p) {
+    return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+template <int W>
+static int simulate(const SimOptions& options) {
+    const int H = DEFAULT_HEIGHT;
+    int threads = options.threads > 0 ? options.threads : max(1u, thread::hardware_concurrency());
+    SimArchive archive;
+    if (!options.archivePath.empty() && !archive.writer.open(options.archivePath.c_str())) {
+        cout << "Cannot open archive " << options.archivePath << " for writing\n";
+        return 1;
+    }
+    SimArchive* sink = options.archivePath.empty() ? nullptr : &archive;
+    vector<WorkQueue> queues(threads);
+    for (long g = 0; g < options.games; ++g)
+        queues[g * threads / options.games].games.push_back(g);
+
+    vector<int> scores(options.games);
+    vector<SimTotals> totals(threads);
+    vector<thread> workers;
+
+    auto start = chrono::steady_clock::now();
+    for (int w = 0; w < threads; ++w) {
+        workers.emplace_back([&, w]() {
+            unique_ptr<Bot<W, H>> bot(options.policy == "bot" ? new Bot<W, H>(options.bot) : nullptr);
+            unique_ptr<MctsBot<W, H>> mcts(options.policy == "mcts" ? new MctsBot<W, H>(options.mcts) : nullptr);
+            long g;
+            while (takeWork(queues, w, g))
+                scores[g] = playGame<W, H>(options.seed + g, options, totals[w], sink, bot.get(), mcts.get());
+        });
+    }
+    for (thread& worker : workers) worker.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (sink && (archive.failed || !archive.writer.commit())) {
+        cout << "Cannot write to archive " << options.archivePath << "\n";
+        return 1;
+    }
+
+    SimTotals all;
+    for (const SimTotals& t : totals) {
+        all.games += t.games;
+        all.pieces += t.pieces;
+        all.ticks += t.ticks;
+        for (int k = 0; k < 5; ++k) all.clears[k] += t.clears[k];
+    }
+    sort(scores.begin(), scores.end());
+    long totalScore = 0;
+    for (int s : scores) totalScore += s;
+
+    cout << "board " << W << "x" << H << ", policy " << options.policy << ", piece cap "
+         << options.pieceCap << ", " << threads << " threads\n";
+    cout << all.games << " games in " << secs << " s: " << all.games / secs << " games/s, "
+         << all.pieces / secs << " pieces/s, " << all.ticks / secs << " ticks/s\n";
+    cout << "line clears: single " << all.clears[1] << ", double " << all.clears[2]
+         << ", triple " << all.clears[3] << ", tetris " << all.clears[4]
+         << " (" << all.clears[0] << " locks cleared nothing)\n";
+    cout << "score: mean " << totalScore / all.games << ", p50 " << percentile(scores, 0.50)
+         << ", p90 " << percentile(scores, 0.90) << ", p99 " << percentile(scores, 0.99)
+         << ", max " << scores.back() << "\n";
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    SimOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string flag = argv[i], value = argv[i + 1];
+        if (flag == "--games") options.games = atol(value.c_str());
+        else if (flag == "--seed") options.seed = strtoull(value.c_str(), 0, 10);
+        else if (flag == "--policy") options.policy = value;
+        else if (flag == "--pieces") options.pieceCap = atol(value.c_str());
+        else if (flag == "--threads") options.threads = atoi(value.c_str());
+        else if (flag == "--width") options.width = atoi(value.c_str());
+        else if (flag == "--record") options.recordDir = value;
+        else if (flag == "--archive") options.archivePath = value;
+        else if (flag == "--lookahead") options.bot.depth = atoi(value.c_str());
+        else if (flag == "--beam") options.bot.width = atoi(value.c_str());
+        else if (flag == "--rollouts") options.mcts.iterations = atoi(value.c_str());
+        else if (flag == "--search-threads") options.mcts.threads = atoi(value.c_str());
+        else { cout << "Unknown option " << flag << "\n"; return 1; }
+    }
+    if (options.policy != "greedy" && options.policy != "bot" && options.policy != "mcts"
+        && options.policy != "random") {
+        cout << "Unknown policy " << options.policy << " (use greedy, bot, mcts or random)\n";
+        return 1;
+    }
+    if (options.games < 1) {
+        cout << "--games must be at least 1\n";
+        return 1;
+    }
+
+    switch (options.width) {
+        case 4:  return simulate<4>(options);
+        case 10: return simulate<10>(options);
+        case 40: return simulate<40>(options);
+    }
+    cout << "Unsupported board width " << options.width << " (use 4, 10 or 40)\n";
+    return 1;
+}
@@ -6,226 +6,72 @@
 #include <termios.h>
 #include <fcntl.h>
 #include <string>
+#include <chrono>
 using namespace std;
 
-#define WIDTH 10
-#define HEIGHT 22
-#define BLOCK "\u2588\u2588"
-#define GHOST "\u2591\u2591"
-#define EMPTY "  "
-
-enum class TetrominoType { I, O, T, S, Z, J, L };
-
-// ANSI color codes
-#define ANSI_COLOR_RESET   "\x1b[0m"
-#define ANSI_COLOR_CYAN    "\x1b[36m"
-#define ANSI_COLOR_YELLOW  "\x1b[33m"
-#define ANSI_COLOR_MAGENTA "\x1b[35m"
-#define ANSI_COLOR_GREEN   "\x1b[32m"
-#define ANSI_COLOR_RED     "\x1b[31m"
-#define ANSI_COLOR_BLUE    "\x1b[34m"
-#define ANSI_COLOR_ORANGE  "\x1b[38;5;208m"
-#define ANSI_COLOR_WHITE   "\x1b[37m"
-#define ANSI_COLOR_GHOST   "\x1b[37;2m"
-
-class Tetromino {
-private:
-    TetrominoType type;
-    int rotation;
-    int x, y;
-    vector<vector<int>> shape;
-    string color;
-
-    void initShape() {
-        switch(type) {
-            case TetrominoType::I:
-                shape = {{0,0,0,0}, {1,1,1,1}, {0,0,0,0}, {0,0,0,0}};
-                color = ANSI_COLOR_CYAN; break;
-            case TetrominoType::O:
-                shape = {{1,1}, {1,1}};
-                color = ANSI_COLOR_YELLOW; break;
-            case TetrominoType::T:
-                shape = {{0,1,0}, {1,1,1}, {0,0,0}};
-                color = ANSI_COLOR_MAGENTA; break;
-            case TetrominoType::S:
-                shape = {{0,1,1}, {1,1,0}, {0,0,0}};
-                color = ANSI_COLOR_GREEN; break;
-            case TetrominoType::Z:
-                shape = {{1,1,0}, {0,1,1}, {0,0,0}};
-                color = ANSI_COLOR_RED; break;
-            case TetrominoType::J:
-                shape = {{1,0,0}, {1,1,1}, {0,0,0}};
-                color = ANSI_COLOR_BLUE; break;
-            case TetrominoType::L:
-                shape = {{0,0,1}, {1,1,1}, {0,0,0}};
-                color = ANSI_COLOR_ORANGE; break;
-        }
-    }
-
-public:
-    Tetromino(TetrominoType t) : type(t), rotation(0), x(WIDTH/2-2), y(0) { initShape(); }
-
-    void rotate() {
-        rotation = (rotation + 1) % 4;
-        vector<vector<int>> newShape(shape[0].size(), vector<int>(shape.size()));
-        for (size_t i = 0; i < shape.size(); ++i)
-            for (size_t j = 0; j < shape[0].size(); ++j)
-                newShape[j][shape.size()-1-i] = shape[i][j];
-        shape = newShape;
-    }
-
-    const vector<vector<int>>& getShape() const { return shape; }
-    int getX() const { return x; }
-    int getY() const { return y; }
-    string getColor() const { return color; }
-    void move(int dx, int dy) { x += dx; y += dy; }
-    Tetromino* clone() const { return new Tetromino(*this); }
-};
-
-class Grid {
-private:
-    vector<vector<string>> grid;
-
-public:
-    Grid() : grid(HEIGHT, vector<string>(WIDTH, "")) {}
-
-    bool isCollision(const Tetromino& t) const {
-        for (size_t i = 0; i < t.getShape().size(); ++i) {
-            for (size_t j = 0; j < t.getShape()[i].size(); ++j) {
-                if (t.getShape()[i][j]) {
-                    int nx = t.getX() + j;
-                    int ny = t.getY() + i;
-                    if (nx < 0 || nx >= WIDTH || ny >= HEIGHT) return true;
-                    if (ny >= 0 && grid[ny][nx] != "") return true;
-                }
-            }
-        }
-        return false;
-    }
-
-    void merge(const Tetromino& t) {
-        for (size_t i = 0; i < t.getShape().size(); ++i) {
-            for (size_t j = 0; j < t.getShape()[i].size(); ++j) {
-                if (t.getShape()[i][j]) {
-                    int x = t.getX() + j;
-                    int y = t.getY() + i;
-                    if (y >= 0) grid[y][x] = t.getColor();
-                }
-            }
-        }
-    }
-
-    int clearLines() {
-        int lines = 0;
-        for (int y = HEIGHT-1; y >= 0; --y) {
-            bool full = true;
-            for (int x = 0; x < WIDTH; ++x)
-                if (grid[y][x] == "") { full = false; break; }
-
-            if (full) {
-                grid.erase(grid.begin() + y);
-                grid.insert(grid.begin(), vector<string>(WIDTH, ""));
-                lines++;
-                y++;
-            }
-        }
-        if (lines > 0) system("aplay -q pop.wav &");
-        return lines;
-    }
-
-    const vector<vector<string>>& getGrid() const { return grid; }
-};
+#include "replay.h"
+#include "playback.h"
+#include "bot.h"
 
+// Terminal front-end for one Engine: keyboard in, board out, sounds on
+// events. Game is instantiated per board size; see main() for the sizes
+// built in.
+template <int W, int H>
 class Game {
 private:
-    Grid grid;
-    Tetromino* current;
-    int score;
-    int level;
-    bool gameOver;
-    bool paused;
+    Engine<W, H> engine;
     string playerName;
+    Events lastEvents;
+    uint64_t seed;
+    long ticks;              // frames played so far
+    ReplayWriter* recorder;  // records each frame's input when set
+    Bot<W, H>* pilot;        // plays instead of the keyboard when set
 
-    void printInstructions() const {
-        cout << "HOW TO PLAY:\n"
-                  << "A - Move Left\n"
-                  << "D - Move Right\n"
-                  << "W - Rotate\n"
-                  << "S - Soft Drop\n"
-                  << "Space - Hard Drop\n"
-                  << "P - Pause/Resume\n"
-                  << "Q/ESC - Quit\n\n";
-    }
-
-    Tetromino* newPiece() {
-        TetrominoType types[] = {TetrominoType::I, TetrominoType::O, TetrominoType::T,
-                                 TetrominoType::S, TetrominoType::Z, TetrominoType::J, TetrominoType::L};
-        return new Tetromino(types[rand() % 7]);
-    }
-
-    void drawGhost(Tetromino* ghost, vector<vector<string>>& tempGrid) const {
-        while (!grid.isCollision(*ghost)) ghost->move(0, 1);
-        ghost->move(0, -1);
-        
-        for (size_t i = 0; i < ghost->getShape().size(); ++i) {
-            for (size_t j = 0; j < ghost->getShape()[i].size(); ++j) {
-                if (ghost->getShape()[i][j]) {
-                    int x = ghost->getX() + j;
-                    int y = ghost->getY() + i;
-                    if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT) {
-                        tempGrid[y][x] = ANSI_COLOR_GHOST;
-                    }
-                }
-            }
+    static Input toInput(char ch) {
+        switch(tolower(ch)) {
+            case 'a': return Input::Left;
+            case 'd': return Input::Right;
+            case 'w': return Input::Rotate;
+            case 's': return Input::SoftDrop;
+            case ' ': return Input::HardDrop;
+            case 27: case 'q': return Input::Quit;
+            case 'p': return Input::Pause;
         }
+        return Input::None;
     }
 
     void draw() const {
+        uint8_t tempGrid[H][W];
+        compose(tempGrid);
+
         system("clear");
         cout << ANSI_COLOR_RESET;
         cout << "Player: " << playerName << "\n";
         
         // Center aligned score
-        string scoreLine = "Score: " + to_string(score) + "  Level: " + to_string(level);
-        int padding = ((WIDTH*2 + 4) - scoreLine.length()) / 2;
-        cout << string(padding > 0 ? padding : 0, ' ') << scoreLine << "\n\n";
-
-        vector<vector<string>> tempGrid = grid.getGrid();
-        
-        // Draw ghost piece
-        Tetromino* ghost = current->clone();
-        drawGhost(ghost, tempGrid);
-        delete ghost;
-
-        // Draw current piece
-        const auto& shape = current->getShape();
-        int tx = current->getX();
-        int ty = current->getY();
-        for (size_t i = 0; i < shape.size(); ++i) {
-            for (size_t j = 0; j < shape[i].size(); ++j) {
-                if (shape[i][j]) {
-                    int x = tx + j;
-                    int y = ty + i;
-                    if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT) {
-                        tempGrid[y][x] = current->getColor();
-                    }
-                }
-            }
+        string scoreLine = "Score: " + to_string(engine.getScore()) + "  Level: " + to_string(engine.getLevel());
+        int padding = ((W*2 + 4) - scoreLine.length()) / 2;
+        cout << string(padding > 0 ? padding : 0, ' ') << scoreLine << "\n";
+        cout << "Next:";
+        for (int i = 0; i < PREVIEW; ++i) {
+            int t = (int)engine.getNext(i);
+            cout << " " << PALETTE[t + 1] << PIECE_NAMES[t] << ANSI_COLOR_RESET;
         }
+        cout << "\n\n";
 
         // Draw game board
         cout << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET;
-        for (int x = 0; x < WIDTH; x++) cout << BLOCK;
+        for (int x = 0; x < W; x++) cout << BLOCK;
         cout << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET << endl;
 
-        for (int y = 0; y < HEIGHT; ++y) {
+        for (int y = 0; y < H; ++y) {
             cout << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET;
-            for (int x = 0; x < WIDTH; ++x) {
-                if (tempGrid[y][x] != "") {
-                    if (tempGrid[y][x] == ANSI_COLOR_GHOST) {
-                        cout << ANSI_COLOR_GHOST << GHOST << ANSI_COLOR_RESET;
+            for (int x = 0; x < W; ++x) {
+                if (tempGrid[y][x]) {
+                    if (tempGrid[y][x] == CELL_GHOST) {
+                        cout << PALETTE[CELL_GHOST] << GHOST << ANSI_COLOR_RESET;
                     } else {
-                        cout << tempGrid[y][x] << BLOCK << ANSI_COLOR_RESET;
+                        cout << PALETTE[tempGrid[y][x]] << BLOCK << ANSI_COLOR_RESET;
                     }
                 } else {
                     cout << EMPTY;
@@ -235,10 +81,10 @@ private:
         }
 
         cout << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET;
-        for (int x = 0; x < WIDTH; x++) cout << BLOCK;
+        for (int x = 0; x < W; x++) cout << BLOCK;
         cout << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET << endl;
 
-        if (paused) {
+        if (engine.isPaused()) {
             cout << "\nPAUSED\n";
             printInstructions();
         }
@@ -265,78 +111,261 @@ private:
     }
 
 public:
-    Game() : score(0), level(1), gameOver(false), paused(false) {
-        srand(time(0));
-        cout << "Enter player name: ";
-        getline(cin, playerName);
-        printInstructions();
-        cout << "Press any key to start...";
-        getchar();
-        current = newPiece();
+    Game(const string& name, uint64_t seed)
+        : engine(seed), playerName(name), lastEvents{}, seed(seed),
+          ticks(0), recorder(nullptr), pilot(nullptr) {}
+
+    static void printInstructions() {
+        cout << "HOW TO PLAY:\n"
+                  << "A - Move Left\n"
+                  << "D - Move Right\n"
+                  << "W - Rotate\n"
+                  << "S - Soft Drop\n"
+                  << "Space - Hard Drop\n"
+                  << "P - Pause/Resume\n"
+                  << "Q/ESC - Quit\n\n";
     }
 
-    ~Game() { delete current; }
+    bool isGameOver() const { return engine.isGameOver(); }
+    long getTicks() const { return ticks; }
+    ReplayResult result() const { return resultOf(engine); }
 
-    void handleInput() {
-        char ch = getInput();
-        if (paused) {
-            if (tolower(ch) == 'p') paused = false;
-            return;
-        }
+    // Record this game's inputs from now on; the caller writes the header
+    // and ends the replay.
+    void record(ReplayWriter* writer) { recorder = writer; }
 
-        Tetromino temp = *current;
-        switch(tolower(ch)) {
-            case 'a': temp.move(-1, 0); break;
-            case 'd': temp.move(1, 0); break;
-            case 'w': temp.rotate(); break;
-            case 's': temp.move(0, 1); break;
-            case ' ': 
-                while (!grid.isCollision(temp)) { 
-                    current->move(0, 1);
-                    temp = *current;
-                }
-                current->move(0, -1);
-                break;
-            case 27: case 'q': gameOver = true; break;
-            case 'p': paused = true; break;
-        }
+    // Let bot place every piece; the keyboard keeps only pause and quit.
+    void autoplay(Bot<W, H>* bot) { pilot = bot; }
+
+    GameState<W, H> snapshot() const { return engine.snapshot(); }
+    void restore(const GameState<W, H>& state) { engine.restore(state); }
+
+    // Board cells with the ghost and the current piece drawn over them.
+    void compose(uint8_t (&tempGrid)[H][W]) const { engine.compose(tempGrid); }
+
+    // Pause between frames; it shortens as the level rises.
+    long frameUsec() const { return 200000 / engine.getLevel(); }
 
-        if (!grid.isCollision(temp)) *current = temp;
+    // One frame of game logic: apply the key (if any), then let gravity
+    // act. With a pilot, keys other than pause and quit are ignored and
+    // the pilot's inputs for the whole placement are sent instead.
+    void tick(char ch) {
+        Input inputs[BOT_MAX_INPUTS];
+        int count = 0;
+        Input input = toInput(ch);
+        if (!pilot || input == Input::Pause || input == Input::Quit) inputs[count++] = input;
+        else count = pilot->choose(engine, inputs, liveBudgetMs(pilot->getOptions().budgetMs, frameUsec()));
+        tick(inputs, count);
     }
 
-    void update() {
-        if (paused) return;
-        Tetromino temp = *current;
-        temp.move(0, 1);
-
-        if (grid.isCollision(temp)) {
-            grid.merge(*current);
-            int lines = grid.clearLines();
-            score += lines * 100 * level;
-            level += lines / 5;
-            delete current;
-            current = newPiece();
-            if (grid.isCollision(*current)) gameOver = true;
-        } else {
-            *current = temp;
+    void tick(const Input* inputs, int count) {
+        if (recorder) {
+            if (recorder->wantsKeyframe(ticks)) recorder->keyframe(ticks, &engine.snapshot(), 1);
+            for (int i = 0; i < count; ++i) recorder->input(ticks, 0, inputs[i]);
         }
+        lastEvents = engine.step(inputs, count);
+        ticks++;
     }
 
     void run() {
-        while (!gameOver) {
+        while (!engine.isGameOver()) {
             draw();
-            handleInput();
-            update();
-            usleep(200000 / level); // Smoother gameplay
+            tick(getInput());
+            if (lastEvents.cleared) system("aplay -q pop.wav &");
+            usleep(frameUsec()); // Smoother gameplay
         }
         system("clear");
-        cout << "GAME OVER! Final Score: " << score << "\n";
+        cout << "GAME OVER! Final Score: " << engine.getScore() << "\n";
+        cout << "Seed: " << seed << "\n";
         system("aplay -q pop2.wav &");
     }
+
+    // Plays a recorded game through the board renderer, at speed times
+    // the pace it was played at, until the viewer quits.
+    void watch(ReplayCursor<W, H>& cursor, double speed) {
+        ReplayPlayback<W, H> playback(cursor, speed);
+        auto last = chrono::steady_clock::now();
+        bool dirty = true;
+        while (true) {
+            char ch = getInput();
+            if (ch) {
+                if (!playback.key(ch)) break;
+                dirty = true;
+            }
+            auto now = chrono::steady_clock::now();
+            double tickSeconds = 0.2 / cursor.getEngine(0).getLevel(); // as run() paces it
+            if (playback.advance(chrono::duration<double>(now - last).count(), tickSeconds)) dirty = true;
+            last = now;
+            if (dirty) {
+                engine.restore(cursor.getEngine(0).snapshot());
+                draw();
+                cout << "\n" << playback.status() << flush;
+                dirty = false;
+            }
+            usleep(REPLAY_FRAME_USEC);
+        }
+        system("clear");
+    }
 };
 
-int main() {
-    Game game;
+template <int W>
+int play(uint64_t seed, const char* recordPath, bool autoplay, const BotOptions& botOptions) {
+    string name = "Autopilot";
+    if (!autoplay) {
+        cout << "Enter player name: ";
+        getline(cin, name);
+        Game<W, DEFAULT_HEIGHT>::printInstructions();
+        cout << "Press any key to start...";
+        getchar();
+    }
+    Game<W, DEFAULT_HEIGHT> game(name, seed);
+    Bot<W, DEFAULT_HEIGHT> bot(autoplay ? botOptions : BotOptions());
+    if (autoplay) game.autoplay(&bot);
+    if (!recordPath) {
+        game.run();
+        return 0;
+    }
+
+    FILE* out = fopen(recordPath, "wb");
+    if (!out) {
+        cout << "Cannot write replay " << recordPath << "\n";
+        return 1;
+    }
+    ReplayWriter writer(out);
+    writer.begin(ReplayHeader{1, W, DEFAULT_HEIGHT, 0, seed, REPLAY_KEYFRAME_INTERVAL});
+    game.record(&writer);
     game.run();
+    ReplayResult result = game.result();
+    writer.end(game.getTicks(), &result, 1);
+    fclose(out);
+    return 0;
+}
+
+template <int W>
+int watch(ReplayReader reader, const ReplayHeader& header, const char* path, double speed) {
+    ReplayCursor<W, DEFAULT_HEIGHT> cursor(reader, header);
+    if (!cursor.index()) {
+        cout << "Cannot read replay " << path << "\n";
+        return 1;
+    }
+    Game<W, DEFAULT_HEIGHT> game(path, header.seed);
+    game.watch(cursor, speed);
     return 0;
-}
\ No newline at end of file
+}
+
+// Shows the first game recorded in path.
+int watchFile(const char* path, double speed) {
+    vector<uint8_t> data;
+    ReplayHeader header;
+    if (!readReplayFile(path, data)) {
+        cout << "Cannot read replay " << path << "\n";
+        return 1;
+    }
+    ReplayReader reader(data.data(), data.size());
+    if (!reader.header(header)) {
+        cout << path << " is not a replay\n";
+        return 1;
+    }
+    if (header.players != 1) {
+        cout << path << " is a two-player replay; watch it with tetrisX2\n";
+        return 1;
+    }
+    if (header.height == DEFAULT_HEIGHT) {
+        switch (header.width) {
+            case 4:  return watch<4>(reader, header, path, speed);
+            case 10: return watch<10>(reader, header, path, speed);
+            case 40: return watch<40>(reader, header, path, speed);
+        }
+    }
+    cout << "Unsupported board " << (int)header.width << "x" << (int)header.height << "\n";
+    return 1;
+}
+
+#ifdef ALLOC_CHECK
+// Check build: g++ -O2 -pthread -DALLOC_CHECK tetris.cpp -o alloc-check
+// Plays 10,000 scripted frames per board size, the second half under the
+// autopilot (restarting whenever a game ends), and fails if any frame
+// allocated from the heap.
+#include "alloc_check.h"
+
+template <int W>
+int checkAllocations() {
+    const char keys[] = "aawd s\0dd\0sw a\0\0ppdw  s";
+    Game<W, DEFAULT_HEIGHT> game("check", 1);
+    BotOptions lookahead; // a small search on two threads, to keep the check quick
+    lookahead.depth = 2;
+    lookahead.width = 4;
+    lookahead.threads = 2;
+    Bot<W, DEFAULT_HEIGHT> bot(lookahead);
+    uint8_t cells[DEFAULT_HEIGHT][W];
+    int games = 1;
+    FILE* sink = tmpfile();
+    ReplayWriter writer(sink);
+    writer.begin(ReplayHeader{1, W, DEFAULT_HEIGHT, 0, 1, REPLAY_KEYFRAME_INTERVAL});
+    game.record(&writer);
+
+    long before = allocationCount;
+    for (int frame = 0; frame < 10000; ++frame) {
+        if (frame == 5000) game.autoplay(&bot);
+        game.tick(keys[frame % (sizeof(keys) - 1)]);
+        game.compose(cells);
+        if (game.isGameOver()) {
+            ReplayResult result = game.result();
+            writer.end(game.getTicks(), &result, 1);
+            game = Game<W, DEFAULT_HEIGHT>("check", games);
+            writer.begin(ReplayHeader{1, W, DEFAULT_HEIGHT, 0, (uint64_t)games, REPLAY_KEYFRAME_INTERVAL});
+            game.record(&writer);
+            if (frame >= 5000) game.autoplay(&bot);
+            games++;
+        }
+    }
+    long allocations = allocationCount - before;
+    fclose(sink);
+
+    cout << W << "x" << DEFAULT_HEIGHT << ": 10000 frames, " << games << " games, "
+         << allocations << " heap allocations\n";
+    return allocations == 0 ? 0 : 1;
+}
+
+int main() {
+    return checkAllocations<4>() | checkAllocations<10>() | checkAllocations<40>();
+}
+
+#else
+// --width picks one of the prebuilt board sizes: 4 (training), 10
+// (standard) or 40 (co-op). --seed fixes the piece sequence; without it
+// the clock picks one, shown at game over. --record FILE saves a replay;
+// --replay FILE watches one, at --speed 0.25 to 64 times the pace it was
+// played at. --autoplay lets the bot play (P pauses, Q quits), searching
+// --lookahead pieces (default 3) across every core for at most --think
+// milliseconds (default 50) a move, and never more than a quarter frame.
+int main(int argc, char** argv) {
+    int width = DEFAULT_WIDTH;
+    uint64_t seed = time(0);
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    double speed = 1;
+    bool autoplay = false;
+    BotOptions botOptions = liveBotOptions();
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--width" && i + 1 < argc) width = atoi(argv[++i]);
+        else if (string(argv[i]) == "--seed" && i + 1 < argc) seed = strtoull(argv[++i], 0, 10);
+        else if (string(argv[i]) == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (string(argv[i]) == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (string(argv[i]) == "--speed" && i + 1 < argc) speed = atof(argv[++i]);
+        else if (string(argv[i]) == "--autoplay") autoplay = true;
+        else if (string(argv[i]) == "--lookahead" && i + 1 < argc) botOptions.depth = atoi(argv[++i]);
+        else if (string(argv[i]) == "--think" && i + 1 < argc) botOptions.budgetMs = atoi(argv[++i]);
+    }
+    if (replayPath) return watchFile(replayPath, speed);
+
+    switch (width) {
+        case 4:  return play<4>(seed, recordPath, autoplay, botOptions);
+        case 10: return play<10>(seed, recordPath, autoplay, botOptions);
+        case 40: return play<40>(seed, recordPath, autoplay, botOptions);
+    }
+    cout << "Unsupported board width " << width << " (use 4, 10 or 40)\n";
+    return 1;
+}
+
+#endif
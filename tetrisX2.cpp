@@ -8,306 +8,76 @@
 #include <string>
 #include <cctype>
 #include <sstream>
+#include <chrono>
 using namespace std;
 
-#define WIDTH 10
-#define HEIGHT 22
-#define BLOCK "\u2588\u2588"
-#define GHOST "\u2591\u2591"
-#define EMPTY "  "
-
-enum class TetrominoType { I, O, T, S, Z, J, L };
-
-// ANSI color codes
-#define ANSI_COLOR_RESET   "\x1b[0m"
-#define ANSI_COLOR_CYAN    "\x1b[36m"
-#define ANSI_COLOR_YELLOW  "\x1b[33m"
-#define ANSI_COLOR_MAGENTA "\x1b[35m"
-#define ANSI_COLOR_GREEN   "\x1b[32m"
-#define ANSI_COLOR_RED     "\x1b[31m"
-#define ANSI_COLOR_BLUE    "\x1b[34m"
-#define ANSI_COLOR_ORANGE  "\x1b[38;5;208m"
-#define ANSI_COLOR_WHITE   "\x1b[37m"
-#define ANSI_COLOR_GHOST   "\x1b[37;2m"
-
-// Tetromino Class (unchanged)
-class Tetromino {
-private:
-    TetrominoType type;
-    int rotation;
-    int x, y;
-    vector<vector<int>> shape;
-    string color;
-
-    void initShape() {
-        switch(type) {
-            case TetrominoType::I:
-                shape = {{0,0,0,0}, {1,1,1,1}, {0,0,0,0}, {0,0,0,0}};
-                color = ANSI_COLOR_CYAN; break;
-            case TetrominoType::O:
-                shape = {{1,1}, {1,1}};
-                color = ANSI_COLOR_YELLOW; break;
-            case TetrominoType::T:
-                shape = {{0,1,0}, {1,1,1}, {0,0,0}};
-                color = ANSI_COLOR_MAGENTA; break;
-            case TetrominoType::S:
-                shape = {{0,1,1}, {1,1,0}, {0,0,0}};
-                color = ANSI_COLOR_GREEN; break;
-            case TetrominoType::Z:
-                shape = {{1,1,0}, {0,1,1}, {0,0,0}};
-                color = ANSI_COLOR_RED; break;
-            case TetrominoType::J:
-                shape = {{1,0,0}, {1,1,1}, {0,0,0}};
-                color = ANSI_COLOR_BLUE; break;
-            case TetrominoType::L:
-                shape = {{0,0,1}, {1,1,1}, {0,0,0}};
-                color = ANSI_COLOR_ORANGE; break;
-        }
-    }
-
-public:
-    Tetromino(TetrominoType t) : type(t), rotation(0), x(WIDTH/2 - 2), y(0) { initShape(); }
-
-    void rotate() {
-        rotation = (rotation + 1) % 4;
-        vector<vector<int>> newShape(shape[0].size(), vector<int>(shape.size()));
-        for (size_t i = 0; i < shape.size(); ++i)
-            for (size_t j = 0; j < shape[0].size(); ++j)
-                newShape[j][shape.size()-1-i] = shape[i][j];
-        shape = newShape;
-    }
-
-    const vector<vector<int>>& getShape() const { return shape; }
-    int getX() const { return x; }
-    int getY() const { return y; }
-    string getColor() const { return color; }
-    void move(int dx, int dy) { x += dx; y += dy; }
-    Tetromino* clone() const { return new Tetromino(*this); }
-    void setPosition(int newX, int newY) { x = newX; y = newY; }
-};
-
-// Grid Class (unchanged)
-class Grid {
-private:
-    vector<vector<string>> grid;
-public:
-    Grid() : grid(HEIGHT, vector<string>(WIDTH, "")) {}
-
-    bool isCollision(const Tetromino& t) const {
-        for (size_t i = 0; i < t.getShape().size(); ++i) {
-            for (size_t j = 0; j < t.getShape()[i].size(); ++j) {
-                if (t.getShape()[i][j]) {
-                    int nx = t.getX() + j;
-                    int ny = t.getY() + i;
-                    if (nx < 0 || nx >= WIDTH || ny >= HEIGHT)
-                        return true;
-                    if (ny >= 0 && grid[ny][nx] != "")
-                        return true;
-                }
-            }
-        }
-        return false;
-    }
-
-    void merge(const Tetromino& t) {
-        for (size_t i = 0; i < t.getShape().size(); ++i) {
-            for (size_t j = 0; j < t.getShape()[i].size(); ++j) {
-                if (t.getShape()[i][j]) {
-                    int x = t.getX() + j;
-                    int y = t.getY() + i;
-                    if (y >= 0)
-                        grid[y][x] = t.getColor();
-                }
-            }
-        }
-    }
-
-    int clearLines() {
-        int lines = 0;
-        for (int y = HEIGHT-1; y >= 0; --y) {
-            bool full = true;
-            for (int x = 0; x < WIDTH; ++x)
-                if (grid[y][x] == "") { full = false; break; }
-            if (full) {
-                grid.erase(grid.begin() + y);
-                grid.insert(grid.begin(), vector<string>(WIDTH, ""));
-                lines++;
-                y++; // check same row index again
-            }
-        }
-        if (lines > 0) system("aplay -q pop.wav &");
-        return lines;
-    }
-
-    const vector<vector<string>>& getGrid() const { return grid; }
-};
+#include "replay.h"
+#include "playback.h"
+#include "bot.h"
 
 // Player Class
-// Encapsulates a single player's board, current tetromino, score, etc.
+// One side of the match: an Engine plus the name and sound bookkeeping.
+// The rules themselves live in Engine.
+template <int W, int H>
 class Player {
-private:
-    Grid grid;
-    Tetromino* current;
-    string colorForGhost = ANSI_COLOR_GHOST;
-    bool gameOverSoundPlayed = false; // ensure we play the game-over sound once
-
-    // Returns a new random tetromino.
-    Tetromino* newPiece() {
-        TetrominoType types[] = {TetrominoType::I, TetrominoType::O, TetrominoType::T,
-                                 TetrominoType::S, TetrominoType::Z, TetrominoType::J, TetrominoType::L};
-        return new Tetromino(types[rand() % 7]);
-    }
-
-    // Draw ghost piece for current tetromino.
-    void drawGhost(vector<vector<string>>& tempGrid) const {
-        Tetromino* ghost = current->clone();
-        while (!grid.isCollision(*ghost))
-            ghost->move(0, 1);
-        ghost->move(0, -1);
-        for (size_t i = 0; i < ghost->getShape().size(); ++i) {
-            for (size_t j = 0; j < ghost->getShape()[i].size(); ++j) {
-                if (ghost->getShape()[i][j]) {
-                    int x = ghost->getX() + j;
-                    int y = ghost->getY() + i;
-                    if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
-                        tempGrid[y][x] = colorForGhost;
-                }
-            }
-        }
-        delete ghost;
-    }
-
 public:
+    Engine<W, H> engine;
     string name;
-    int score;
-    int level;
-    bool gameOver;
-    bool paused;
     int playerId; // 1 or 2
+    Events lastEvents = {};           // what the last step() did, for the sounds
+    bool gameOverSoundPlayed = false; // ensure we play the game-over sound once
 
-    Player(int id, const string& n) : name(n), score(0), level(1),
-        gameOver(false), paused(false), playerId(id) { current = newPiece(); }
-
-    ~Player() { delete current; }
+    // seed picks the piece sequence (MultiplayerGame decides whether the two
+    // players share one). In versus play any block left in the top row ends
+    // that player's game.
+    Player(int id, const string& n, uint64_t seed)
+        : engine(seed, true), name(n), playerId(id) {}
 
-    // Process input command for this player.
-    // cmd: "L", "R", "rotate", "soft", "hard", "pause", "quit"
-    void processCommand(const string& cmd) {
-        if (paused) {
-            if (cmd == "pause")
-                paused = false;
-            return;
-        }
-        Tetromino temp = *current;
-        if (cmd == "L")           temp.move(-1, 0);
-        else if (cmd == "R")      temp.move(1, 0);
-        else if (cmd == "rotate") temp.rotate();
-        else if (cmd == "soft")   temp.move(0, 1);
-        else if (cmd == "hard") {
-            // hard drop: move until collision
-            while (!grid.isCollision(temp)) {
-                current->move(0, 1);
-                temp = *current;
-            }
-            current->move(0, -1);
-        }
-        else if (cmd == "pause") { paused = true; return; }
-        else if (cmd == "quit") { gameOver = true; return; }
-        if (!grid.isCollision(temp))
-            *current = temp;
-    }
+    GameState<W, H> snapshot() const { return engine.snapshot(); }
+    void restore(const GameState<W, H>& state) { engine.restore(state); }
 
-    // Update the player's board.
-    void update() {
-        if (paused || gameOver) return;
-        Tetromino temp = *current;
-        temp.move(0, 1);
-        if (grid.isCollision(temp)) {
-            grid.merge(*current);
-            int lines = grid.clearLines();
-            score += lines * 100 * level;
-            level += lines / 5;
-            delete current;
-            current = newPiece();
-            // Check for game over if any block exists in the top row.
-            const auto& gridData = grid.getGrid();
-            for (int x = 0; x < WIDTH; x++) {
-                if (gridData[0][x] != "") {
-                    gameOver = true;
-                    break;
-                }
-            }
-            // Also check if the new piece immediately collides.
-            if (grid.isCollision(*current))
-                gameOver = true;
-        } else {
-            *current = temp;
-        }
+    // Apply this frame's inputs, then gravity.
+    void step(const Input* inputs, int count) { lastEvents = engine.step(inputs, count); }
 
-        // If this player's game just ended, play pop2.wav once.
-        if (gameOver && !gameOverSoundPlayed) {
-            system("aplay -q pop2.wav &");
-            gameOverSoundPlayed = true;
-        }
-    }
+    // Fill tempGrid with the board plus the ghost and current piece.
+    void compose(uint8_t (&tempGrid)[H][W]) const { engine.compose(tempGrid); }
 
     // Render the player's board (including header) into a vector of strings.
     vector<string> render() const {
         vector<string> lines;
         stringstream ss;
         // Prepare temporary grid including ghost and current piece.
-        vector<vector<string>> tempGrid = grid.getGrid();
-        // Draw ghost piece
-        {
-            Tetromino* ghost = current->clone();
-            while (!grid.isCollision(*ghost))
-                ghost->move(0, 1);
-            ghost->move(0, -1);
-            for (size_t i = 0; i < ghost->getShape().size(); ++i) {
-                for (size_t j = 0; j < ghost->getShape()[i].size(); ++j) {
-                    if (ghost->getShape()[i][j]) {
-                        int x = ghost->getX() + j;
-                        int y = ghost->getY() + i;
-                        if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
-                            tempGrid[y][x] = ANSI_COLOR_GHOST;
-                    }
-                }
-            }
-            delete ghost;
-        }
-        // Draw current piece
-        const auto& shape = current->getShape();
-        int tx = current->getX();
-        int ty = current->getY();
-        for (size_t i = 0; i < shape.size(); ++i)
-            for (size_t j = 0; j < shape[i].size(); ++j)
-                if (shape[i][j]) {
-                    int x = tx + j;
-                    int y = ty + i;
-                    if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
-                        tempGrid[y][x] = current->getColor();
-                }
+        uint8_t tempGrid[H][W];
+        compose(tempGrid);
         // Build header line.
-        string header = name + "  Score: " + to_string(score) + "  Level: " + to_string(level);
-        int headerPad = (WIDTH*2 + 4 - header.length())/2;
+        string header = name + "  Score: " + to_string(engine.getScore()) + "  Level: " + to_string(engine.getLevel());
+        int headerPad = (W*2 + 4 - header.length())/2;
         ss << string(headerPad > 0 ? headerPad : 0, ' ') << header;
         lines.push_back(ss.str());
         ss.str("");
+        // Build the preview line.
+        ss << "  Next:";
+        for (int i = 0; i < PREVIEW; ++i) {
+            int t = (int)engine.getNext(i);
+            ss << " " << PALETTE[t + 1] << PIECE_NAMES[t] << ANSI_COLOR_RESET;
+        }
+        lines.push_back(ss.str());
+        ss.str("");
         // Build top border.
         ss << ANSI_COLOR_WHITE << BLOCK;
-        for (int x = 0; x < WIDTH; x++) ss << BLOCK;
+        for (int x = 0; x < W; x++) ss << BLOCK;
         ss << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET;
         lines.push_back(ss.str());
         ss.str("");
         // Build each row of the board.
-        for (int y = 0; y < HEIGHT; ++y) {
+        for (int y = 0; y < H; ++y) {
             ss << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET;
-            for (int x = 0; x < WIDTH; ++x) {
-                if (tempGrid[y][x] != "") {
-                    if (tempGrid[y][x] == ANSI_COLOR_GHOST)
-                        ss << ANSI_COLOR_GHOST << GHOST << ANSI_COLOR_RESET;
+            for (int x = 0; x < W; ++x) {
+                if (tempGrid[y][x]) {
+                    if (tempGrid[y][x] == CELL_GHOST)
+                        ss << PALETTE[CELL_GHOST] << GHOST << ANSI_COLOR_RESET;
                     else
-                        ss << tempGrid[y][x] << BLOCK << ANSI_COLOR_RESET;
+                        ss << PALETTE[tempGrid[y][x]] << BLOCK << ANSI_COLOR_RESET;
                 } else {
                     ss << EMPTY;
                 }
@@ -318,11 +88,11 @@ public:
         }
         // Build bottom border.
         ss << ANSI_COLOR_WHITE << BLOCK;
-        for (int x = 0; x < WIDTH; x++) ss << BLOCK;
+        for (int x = 0; x < W; x++) ss << BLOCK;
         ss << ANSI_COLOR_WHITE << BLOCK << ANSI_COLOR_RESET;
         lines.push_back(ss.str());
         // If paused, add a pause message.
-        if (paused) {
+        if (engine.isPaused()) {
             lines.push_back("  PAUSED");
         }
         return lines;
@@ -350,52 +120,68 @@ string getInput() {
 }
 
 // MultiplayerGame Class
+// Both boards share one size; see main() for the sizes built in.
+template <int W, int H>
 class MultiplayerGame {
 private:
-    Player player1;
-    Player player2;
+    Player<W, H> player1;
+    Player<W, H> player2;
     bool globalQuit;
+    uint64_t seed;
+    long ticks;              // frames played so far
+    ReplayWriter* recorder;  // records each frame's inputs when set
+    Bot<W, H>* pilots[2];    // plays a seat instead of its keys when set
 public:
-    MultiplayerGame(const string& name1, const string& name2)
-        : player1(1, name1), player2(2, name2), globalQuit(false) {
-        srand(time(0));
-    }
+    // With samePieces both players are dealt the identical sequence from the
+    // seed, so the match is decided by play rather than by the draw.
+    MultiplayerGame(const string& name1, const string& name2, uint64_t seed, bool samePieces = false)
+        : player1(1, name1, versusSeed(seed, 1, samePieces)),
+          player2(2, name2, versusSeed(seed, 2, samePieces)),
+          globalQuit(false), seed(seed), ticks(0), recorder(nullptr), pilots{} {}
 
-    // Dispatch input characters to the appropriate player commands.
+    // Inputs for one player collected over a frame. Keys beyond the
+    // capacity in a single frame are dropped.
+    struct FrameInputs {
+        Input keys[32];
+        int count = 0;
+        void push(Input input) { if (count < 32) keys[count++] = input; }
+    };
+
+    // Dispatch input characters to the appropriate player's inputs.
     // For player1: keys: a (L), d (R), w (rotate), s (soft), space (hard)
     // For player2: arrow keys and Enter: ESC+[+ 'D' (L), ESC+[+'C' (R), ESC+[+'A' (rotate), ESC+[+'B' (soft), Enter (hard))
-    void handleInput(const string& input) {
+    void handleInput(const string& input, FrameInputs& inputs1, FrameInputs& inputs2) {
         size_t i = 0;
         while (i < input.size()) {
             char ch = input[i];
             // Check for escape sequence (arrow keys for Player2)
             if (ch == '\033' && i + 2 < input.size() && input[i+1]=='[') {
                 char arrow = input[i+2];
-                if (arrow == 'D') player2.processCommand("L");
-                else if (arrow == 'C') player2.processCommand("R");
-                else if (arrow == 'A') player2.processCommand("rotate");
-                else if (arrow == 'B') player2.processCommand("soft");
+                if (arrow == 'D') inputs2.push(Input::Left);
+                else if (arrow == 'C') inputs2.push(Input::Right);
+                else if (arrow == 'A') inputs2.push(Input::Rotate);
+                else if (arrow == 'B') inputs2.push(Input::SoftDrop);
                 i += 3;
             } else {
                 if (ch == 'a' || ch == 'A') {
-                    player1.processCommand("L");
+                    inputs1.push(Input::Left);
                 } else if (ch == 'd' || ch == 'D') {
-                    player1.processCommand("R");
+                    inputs1.push(Input::Right);
                 } else if (ch == 'w' || ch == 'W') {
-                    player1.processCommand("rotate");
+                    inputs1.push(Input::Rotate);
                 } else if (ch == 's' || ch == 'S') {
-                    player1.processCommand("soft");
+                    inputs1.push(Input::SoftDrop);
                 } else if (ch == ' ') {
-                    player1.processCommand("hard");
+                    inputs1.push(Input::HardDrop);
                 } else if (ch == '\n' || ch == '\r') { // Enter for Player2 hard drop
-                    player2.processCommand("hard");
+                    inputs2.push(Input::HardDrop);
                 } else if (tolower(ch) == 'p') {
                     // Global pause toggle.
-                    player1.processCommand("pause");
-                    player2.processCommand("pause");
+                    inputs1.push(Input::Pause);
+                    inputs2.push(Input::Pause);
                 } else if (ch == 'q' || ch == 27) {
-                    player1.processCommand("quit");
-                    player2.processCommand("quit");
+                    inputs1.push(Input::Quit);
+                    inputs2.push(Input::Quit);
                     globalQuit = true;
                 }
                 i++;
@@ -418,47 +204,311 @@ public:
         cout << "\nPress 'q' or ESC to quit.\n";
     }
 
-    // Update both players.
-    void update() {
-        if (!player1.paused && !player1.gameOver) player1.update();
-        if (!player2.paused && !player2.gameOver) player2.update();
+    // Pause between frames, set by the players' mean level.
+    long frameUsec() const {
+        return 300000 / ((player1.engine.getLevel() + player2.engine.getLevel())/2 + 1);
+    }
+
+    // Keeps only the pause and quit keys in a bot seat's inputs; if there
+    // were none, the bot's inputs for its whole placement replace them.
+    void pilot(Bot<W, H>& bot, const Player<W, H>& player, FrameInputs& inputs) const {
+        int kept = 0;
+        for (int i = 0; i < inputs.count; ++i)
+            if (inputs.keys[i] == Input::Pause || inputs.keys[i] == Input::Quit) inputs.keys[kept++] = inputs.keys[i];
+        inputs.count = kept;
+        if (!kept) inputs.count = bot.choose(player.engine, inputs.keys,
+                                             liveBudgetMs(bot.getOptions().budgetMs, frameUsec()));
+    }
+
+    // One frame of game logic: dispatch pending keys, then let gravity act.
+    void tick(const string& input) {
+        FrameInputs inputs1, inputs2;
+        handleInput(input, inputs1, inputs2);
+        if (pilots[0]) pilot(*pilots[0], player1, inputs1);
+        if (pilots[1]) pilot(*pilots[1], player2, inputs2);
+        if (recorder) {
+            if (recorder->wantsKeyframe(ticks)) {
+                GameState<W, H> states[2] = {player1.snapshot(), player2.snapshot()};
+                recorder->keyframe(ticks, states, 2);
+            }
+            for (int i = 0; i < inputs1.count; ++i) recorder->input(ticks, 0, inputs1.keys[i]);
+            for (int i = 0; i < inputs2.count; ++i) recorder->input(ticks, 1, inputs2.keys[i]);
+        }
+        player1.step(inputs1.keys, inputs1.count);
+        player2.step(inputs2.keys, inputs2.count);
+        ticks++;
+    }
+
+    long getTicks() const { return ticks; }
+
+    void results(ReplayResult (&out)[2]) const {
+        out[0] = resultOf(player1.engine);
+        out[1] = resultOf(player2.engine);
+    }
+
+    // Record both players' inputs from now on; the caller writes the
+    // header and ends the replay.
+    void record(ReplayWriter* writer) { recorder = writer; }
+
+    // Let bot play player playerId (1 or 2).
+    void autoplay(int playerId, Bot<W, H>* bot) { pilots[playerId - 1] = bot; }
+
+    // Fill the two cell buffers with each player's board as it is drawn.
+    void compose(uint8_t (&cells1)[H][W], uint8_t (&cells2)[H][W]) const {
+        player1.compose(cells1);
+        player2.compose(cells2);
+    }
+
+    // Line-clear pop for either player, and pop2.wav once per finished player.
+    void playSounds(Player<W, H>& player) {
+        if (player.lastEvents.cleared) system("aplay -q pop.wav &");
+        if (player.engine.isGameOver() && !player.gameOverSoundPlayed) {
+            system("aplay -q pop2.wav &");
+            player.gameOverSoundPlayed = true;
+        }
     }
 
     // Check if both players are finished (or global quit was requested).
     bool isGameOver() {
-        return globalQuit || (player1.gameOver && player2.gameOver);
+        return globalQuit || (player1.engine.isGameOver() && player2.engine.isGameOver());
     }
 
     void run() {
         while (!isGameOver()) {
             draw();
-            string inp = getInput();
-            if (!inp.empty()) handleInput(inp);
-            update();
-            usleep(300000 / ((player1.level + player2.level)/2 + 1));
+            tick(getInput());
+            playSounds(player1);
+            playSounds(player2);
+            usleep(frameUsec());
         }
         system("clear");
         cout << "GAME OVER!\n";
-        cout << player1.name << " Score: " << player1.score << "\n";
-        cout << player2.name << " Score: " << player2.score << "\n";
+        cout << player1.name << " Score: " << player1.engine.getScore() << "\n";
+        cout << player2.name << " Score: " << player2.engine.getScore() << "\n";
+        cout << "Seed: " << seed << "\n";
         // If any game over sound hasn't been played (should not occur, but for safety)
         system("aplay -q pop2.wav &");
     }
+
+    // Plays a recorded match through the board renderer, at speed times
+    // the pace it was played at, until the viewer quits.
+    void watch(ReplayCursor<W, H>& cursor, double speed) {
+        ReplayPlayback<W, H> playback(cursor, speed);
+        auto last = chrono::steady_clock::now();
+        bool dirty = true;
+        while (true) {
+            string input = getInput();
+            bool quit = false;
+            for (size_t i = 0; i < input.size() && !quit; ++i) {
+                char ch = input[i];
+                // Left and right arrows step back and forward.
+                if (ch == '\033' && i + 2 < input.size() && input[i+1] == '[') {
+                    i += 2;
+                    ch = input[i] == 'C' ? '.' : input[i] == 'D' ? ',' : '\0';
+                }
+                quit = !playback.key(ch);
+            }
+            if (quit) break;
+            if (!input.empty()) dirty = true;
+            auto now = chrono::steady_clock::now();
+            int levels = cursor.getEngine(0).getLevel() + cursor.getEngine(1).getLevel();
+            double tickSeconds = 0.3 / (levels / 2 + 1); // as run() paces it
+            if (playback.advance(chrono::duration<double>(now - last).count(), tickSeconds)) dirty = true;
+            last = now;
+            if (dirty) {
+                player1.restore(cursor.getEngine(0).snapshot());
+                player2.restore(cursor.getEngine(1).snapshot());
+                draw();
+                cout << playback.status() << flush;
+                dirty = false;
+            }
+            usleep(REPLAY_FRAME_USEC);
+        }
+        system("clear");
+    }
 };
 
+template <int W>
+int watch(ReplayReader reader, const ReplayHeader& header, const char* path, double speed) {
+    ReplayCursor<W, DEFAULT_HEIGHT> cursor(reader, header);
+    if (!cursor.index()) {
+        cout << "Cannot read replay " << path << "\n";
+        return 1;
+    }
+    MultiplayerGame<W, DEFAULT_HEIGHT> game("Player 1", "Player 2", header.seed,
+                                            header.flags & REPLAY_SAME_PIECES);
+    game.watch(cursor, speed);
+    return 0;
+}
+
+// Shows the first match recorded in path.
+int watchFile(const char* path, double speed) {
+    vector<uint8_t> data;
+    ReplayHeader header;
+    if (!readReplayFile(path, data)) {
+        cout << "Cannot read replay " << path << "\n";
+        return 1;
+    }
+    ReplayReader reader(data.data(), data.size());
+    if (!reader.header(header)) {
+        cout << path << " is not a replay\n";
+        return 1;
+    }
+    if (header.players != 2) {
+        cout << path << " is a single-player replay; watch it with tetris\n";
+        return 1;
+    }
+    if (header.height == DEFAULT_HEIGHT) {
+        switch (header.width) {
+            case 4:  return watch<4>(reader, header, path, speed);
+            case 10: return watch<10>(reader, header, path, speed);
+            case 40: return watch<40>(reader, header, path, speed);
+        }
+    }
+    cout << "Unsupported board " << (int)header.width << "x" << (int)header.height << "\n";
+    return 1;
+}
+
+#ifdef ALLOC_CHECK
+// Check build: g++ -O2 -pthread -DALLOC_CHECK tetrisX2.cpp -o alloc-check
+// Plays 10,000 scripted frames per board size, player 2 as a bot
+// (restarting whenever the match ends), and fails if any frame allocated
+// from the heap.
+#include "alloc_check.h"
+
+template <int W>
+int checkAllocations() {
+    const string inputs[] = {"a", "\033[D", "", "w\033[A", "d\033[C", " ", "",
+                             "\033[B\n", "s", "dd\033[C\033[C", "", "p", "p", "\r"};
+    const int count = sizeof(inputs) / sizeof(inputs[0]);
+    MultiplayerGame<W, DEFAULT_HEIGHT> game("one", "two", 1, true);
+    BotOptions lookahead; // a small search on two threads, to keep the check quick
+    lookahead.depth = 2;
+    lookahead.width = 4;
+    lookahead.threads = 2;
+    Bot<W, DEFAULT_HEIGHT> bot(lookahead);
+    game.autoplay(2, &bot);
+    uint8_t cells1[DEFAULT_HEIGHT][W], cells2[DEFAULT_HEIGHT][W];
+    int matches = 1;
+    FILE* sink = tmpfile();
+    ReplayWriter writer(sink);
+    writer.begin(ReplayHeader{2, W, DEFAULT_HEIGHT, REPLAY_SAME_PIECES, 1, REPLAY_KEYFRAME_INTERVAL});
+    game.record(&writer);
+
+    long before = allocationCount;
+    for (int frame = 0; frame < 10000; ++frame) {
+        game.tick(inputs[frame % count]);
+        game.compose(cells1, cells2);
+        if (game.isGameOver()) {
+            ReplayResult results[2];
+            game.results(results);
+            writer.end(game.getTicks(), results, 2);
+            game = MultiplayerGame<W, DEFAULT_HEIGHT>("one", "two", matches);
+            writer.begin(ReplayHeader{2, W, DEFAULT_HEIGHT, 0, (uint64_t)matches, REPLAY_KEYFRAME_INTERVAL});
+            game.record(&writer);
+            game.autoplay(2, &bot);
+            matches++;
+        }
+    }
+    long allocations = allocationCount - before;
+    fclose(sink);
+
+    cout << W << "x" << DEFAULT_HEIGHT << ": 10000 frames, " << matches << " matches, "
+         << allocations << " heap allocations\n";
+    return allocations == 0 ? 0 : 1;
+}
+
 int main() {
-    string name1, name2;
-    cout << "Enter Player 1 name (WASD & Spacebar): ";
-    getline(cin, name1);
-    cout << "Enter Player 2 name (Arrow Keys & Enter): ";
-    getline(cin, name2);
+    return checkAllocations<4>() | checkAllocations<10>() | checkAllocations<40>();
+}
+
+#else
+template <int W>
+int play(const string& name1, const string& name2, uint64_t seed, bool samePieces,
+         const char* recordPath, int botSeat, const BotOptions& botOptions) {
+    MultiplayerGame<W, DEFAULT_HEIGHT> game(name1, name2, seed, samePieces);
+    Bot<W, DEFAULT_HEIGHT> bot(botSeat ? botOptions : BotOptions());
+    if (botSeat) game.autoplay(botSeat, &bot);
+    if (!recordPath) {
+        game.run();
+        return 0;
+    }
+
+    FILE* out = fopen(recordPath, "wb");
+    if (!out) {
+        cout << "Cannot write replay " << recordPath << "\n";
+        return 1;
+    }
+    ReplayWriter writer(out);
+    writer.begin(ReplayHeader{2, W, DEFAULT_HEIGHT, (uint8_t)(samePieces ? REPLAY_SAME_PIECES : 0), seed,
+                              REPLAY_KEYFRAME_INTERVAL});
+    game.record(&writer);
+    game.run();
+    ReplayResult results[2];
+    game.results(results);
+    writer.end(game.getTicks(), results, 2);
+    fclose(out);
+    return 0;
+}
+
+// --width picks one of the prebuilt board sizes: 4 (training), 10
+// (standard) or 40 (co-op). --seed fixes both players' piece sequences;
+// without it the clock picks one, shown at game over. --same-pieces deals
+// both players the same sequence. --record FILE saves a replay; --replay
+// FILE watches one, at --speed 0.25 to 64 times the pace it was played at.
+// --bot 1 or --bot 2 seats the bot as that player, searching --lookahead
+// pieces (default 3) across every core for at most --think milliseconds
+// (default 50) a move, and never more than a quarter frame.
+int main(int argc, char** argv) {
+    int width = DEFAULT_WIDTH;
+    uint64_t seed = time(0);
+    bool samePieces = false;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    double speed = 1;
+    int botSeat = 0;
+    BotOptions botOptions = liveBotOptions();
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--width" && i + 1 < argc) width = atoi(argv[++i]);
+        else if (string(argv[i]) == "--seed" && i + 1 < argc) seed = strtoull(argv[++i], 0, 10);
+        else if (string(argv[i]) == "--same-pieces") samePieces = true;
+        else if (string(argv[i]) == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (string(argv[i]) == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (string(argv[i]) == "--speed" && i + 1 < argc) speed = atof(argv[++i]);
+        else if (string(argv[i]) == "--bot" && i + 1 < argc) botSeat = atoi(argv[++i]);
+        else if (string(argv[i]) == "--lookahead" && i + 1 < argc) botOptions.depth = atoi(argv[++i]);
+        else if (string(argv[i]) == "--think" && i + 1 < argc) botOptions.budgetMs = atoi(argv[++i]);
+    }
+    if (replayPath) return watchFile(replayPath, speed);
+    if (width != 4 && width != 10 && width != 40) {
+        cout << "Unsupported board width " << width << " (use 4, 10 or 40)\n";
+        return 1;
+    }
+    if (botSeat < 0 || botSeat > 2) {
+        cout << "No player " << botSeat << " to seat the bot as (use 1 or 2)\n";
+        return 1;
+    }
+
+    string name1 = "Bot", name2 = "Bot";
+    if (botSeat != 1) {
+        cout << "Enter Player 1 name (WASD & Spacebar): ";
+        getline(cin, name1);
+    }
+    if (botSeat != 2) {
+        cout << "Enter Player 2 name (Arrow Keys & Enter): ";
+        getline(cin, name2);
+    }
     cout << "\nHOW TO PLAY:\n"
               << "Player 1: A - Left, D - Right, W - Rotate, S - Soft Drop, Space - Hard Drop\n"
               << "Player 2: Arrow Left/Right - Move, Arrow Up - Rotate, Arrow Down - Soft Drop, Enter - Hard Drop\n"
               << "P - Pause, Q/ESC - Quit\n\n"
               << "Press any key to start...";
     getchar();
-    MultiplayerGame game(name1, name2);
-    game.run();
-    return 0;
+    switch (width) {
+        case 4:  return play<4>(name1, name2, seed, samePieces, recordPath, botSeat, botOptions);
+        case 40: return play<40>(name1, name2, seed, samePieces, recordPath, botSeat, botOptions);
+        default: return play<10>(name1, name2, seed, samePieces, recordPath, botSeat, botOptions);
+    }
 }
+
+#endif
@@ -0,0 +1,202 @@
+// Replay verifier: re-simulates every recorded game headless and checks
+// each player's recorded score, lines and state hash against the replay,
+// and every keyframe against the state simulated up to it.
+//
+//   g++ -O2 -pthread verify.cpp -o tetris-verify
+//   ./tetris-verify DIR|FILE|ARCHIVE... [--threads T]
+//
+// A directory is scanned for files (one level); a file may hold several
+// replays back to back, and each game in an archive is verified on its
+// own. Exits 1 if any replay fails.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <dirent.h>
+#include <sys/stat.h>
+using namespace std;
+
+#include "replay.h"
+#include "archive.h"
+
+// Totals gathered by one worker; merged once all files are done.
+struct VerifyTotals {
+    long games = 0;
+    long passed = 0;
+    long unchecked = 0; // version 1 replays carry no results
+    long ticks = 0;
+    vector<string> failures;
+};
+
+// Replays one game and compares every player's end state with the
+// recorded result. Returns "" when it matches, else the reason.
+template <int W, int H>
+static string verifyGame(ReplayReader& reader, const ReplayHeader& header, VerifyTotals& totals) {
+    ReplayCursor<W, H> cursor(reader, header);
+    bool ok = cursor.finish();
+    reader = cursor.getReader();
+    if (!ok) return "malformed input stream or keyframe";
+    totals.ticks += cursor.getTick();
+    if (reader.getVersion() < 2) {
+        totals.unchecked++;
+        return "";
+    }
+
+    for (int p = 0; p < header.players; ++p) {
+        ReplayResult recorded, actual = resultOf(cursor.getEngine(p));
+        if (!reader.result(recorded)) return "truncated result";
+        if (recorded.score != actual.score)
+            return "player " + to_string(p + 1) + " score " + to_string(recorded.score)
+                   + " recorded, " + to_string(actual.score) + " replayed";
+        if (recorded.lines != actual.lines)
+            return "player " + to_string(p + 1) + " lines " + to_string(recorded.lines)
+                   + " recorded, " + to_string(actual.lines) + " replayed";
+        if (recorded.hash != actual.hash)
+            return "player " + to_string(p + 1) + " state hash differs";
+    }
+    totals.passed++;
+    return "";
+}
+
+// Verifies every replay in data, stopping at the first one that cannot be
+// decoded since the rest cannot be framed.
+static void verifyReplays(const string& path, const uint8_t* data, size_t size, VerifyTotals& totals) {
+    ReplayReader reader(data, size);
+    for (int index = 0; reader.position() < data + size; ++index) {
+        string where = path + " #" + to_string(index) + ": ";
+        ReplayHeader header;
+        totals.games++;
+        if (!reader.header(header)) {
+            totals.failures.push_back(where + "bad header");
+            return;
+        }
+        string error;
+        if (header.height != DEFAULT_HEIGHT) error = "unsupported board";
+        else if (header.width == 4) error = verifyGame<4, DEFAULT_HEIGHT>(reader, header, totals);
+        else if (header.width == 10) error = verifyGame<10, DEFAULT_HEIGHT>(reader, header, totals);
+        else if (header.width == 40) error = verifyGame<40, DEFAULT_HEIGHT>(reader, header, totals);
+        else error = "unsupported board";
+        if (!error.empty()) {
+            totals.failures.push_back(where + error);
+            if (error == "unsupported board" || error == "malformed input stream or keyframe"
+                || error == "truncated result")
+                return;
+        }
+    }
+}
+
+// One unit of work: a whole replay file, or one game in an archive.
+struct VerifyJob {
+    long size;
+    int file;
+    long game; // -1 for a replay file
+    bool operator<(const VerifyJob& other) const { return size < other.size; }
+};
+
+static void verifyJob(const VerifyJob& job, const vector<string>& paths,
+                      const vector<unique_ptr<ArchiveReader>>& archives, VerifyTotals& totals) {
+    const string& path = paths[job.file];
+    if (job.game >= 0) {
+        const ArchiveReader& archive = *archives[job.file];
+        verifyReplays(path + " game " + to_string(job.game), archive.replay(job.game),
+                      archive.entry(job.game).length, totals);
+        return;
+    }
+    vector<uint8_t> data;
+    if (!readReplayFile(path.c_str(), data)) {
+        totals.failures.push_back(path + ": cannot read");
+        return;
+    }
+    verifyReplays(path, data.data(), data.size(), totals);
+}
+
+static void listFiles(const string& path, vector<pair<long, string>>& files) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        files.push_back({0, path}); // reported as unreadable
+        return;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        files.push_back({(long)info.st_size, path});
+        return;
+    }
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return;
+    while (dirent* entry = readdir(dir)) {
+        string child = path + "/" + entry->d_name;
+        if (entry->d_name[0] != '.' && stat(child.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+            files.push_back({(long)info.st_size, child});
+    }
+    closedir(dir);
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    vector<pair<long, string>> files;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else listFiles(argv[i], files);
+    }
+    if (files.empty()) {
+        cout << "Usage: tetris-verify DIR|FILE|ARCHIVE... [--threads T]\n";
+        return 1;
+    }
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+
+    // Archives are mapped once and shared; their games are verified
+    // separately so one large archive still spreads across the workers.
+    vector<string> paths;
+    vector<unique_ptr<ArchiveReader>> archives;
+    vector<VerifyJob> jobs;
+    for (const pair<long, string>& file : files) {
+        int f = (int)paths.size();
+        paths.push_back(file.second);
+        archives.emplace_back(new ArchiveReader());
+        if (!archives[f]->open(file.second.c_str())) {
+            jobs.push_back(VerifyJob{file.first, f, -1});
+            continue;
+        }
+        for (size_t g = 0; g < archives[f]->getCount(); ++g)
+            jobs.push_back(VerifyJob{(long)archives[f]->entry(g).length, f, (long)g});
+    }
+
+    // Largest first, handed out one at a time, so the long games start
+    // early and the small ones fill in the gaps at the end.
+    sort(jobs.rbegin(), jobs.rend());
+    atomic<size_t> next(0);
+    vector<VerifyTotals> totals(threads);
+    vector<thread> workers;
+
+    auto start = chrono::steady_clock::now();
+    for (int w = 0; w < threads; ++w) {
+        workers.emplace_back([&, w]() {
+            for (size_t j; (j = next++) < jobs.size(); )
+                verifyJob(jobs[j], paths, archives, totals[w]);
+        });
+    }
+    for (thread& worker : workers) worker.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    VerifyTotals all;
+    for (VerifyTotals& t : totals) {
+        all.games += t.games;
+        all.passed += t.passed;
+        all.unchecked += t.unchecked;
+        all.ticks += t.ticks;
+        all.failures.insert(all.failures.end(), t.failures.begin(), t.failures.end());
+    }
+    sort(all.failures.begin(), all.failures.end());
+    for (const string& failure : all.failures) cout << "FAIL " << failure << "\n";
+
+    cout << files.size() << " files, " << all.games << " games: " << all.passed << " passed, "
+         << all.failures.size() << " failed";
+    if (all.unchecked) cout << ", " << all.unchecked << " without results (version 1)";
+    cout << "\n" << all.ticks << " ticks in " << secs << " s: " << all.ticks / secs / 1e6
+         << " M ticks/s, " << all.ticks / secs / threads / 1e6 << " M ticks/s per thread ("
+         << threads << " threads)\n";
+    return all.failures.empty() ? 0 : 1;
+}